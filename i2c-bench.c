@@ -0,0 +1,459 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * I2C transfer benchmark
+ *
+ * Runs a workload through i2c_transfer() on any adapter and reports what it
+ * delivered. It is controlled through debugfs i2c-bench/run: writing
+ * "key=value" pairs sets the workload and runs it in the writer's context,
+ * reading the file shows the workload and the results of the last run.
+ * Keys keep their values between runs.
+ *
+ *   adapter=<nr>      adapter number (0)
+ *   addr=<addr>       7-bit target address (0x50)
+ *   len=<bytes>       payload bytes per message (32)
+ *   msgs=<n>          messages per i2c_transfer() call (1)
+ *   read_pct=<0-100>  share of messages that read, spread evenly (0)
+ *   combo=<bytes>     precede each read by a write of this many bytes in the
+ *                     same transfer, i.e. a repeated start, 0 for none (0)
+ *   iterations=<n>    i2c_transfer() calls (1000)
+ *   adapters=<n>      run the workload on this many adapters from <adapter>
+ *                     on, at the same time, each from its own kernel thread
+ *                     on its own CPU while there are enough of them (1)
+ *
+ * For example, against the i2c-slave-eeprom loopback on the slave block of
+ * controller 0:
+ *
+ *   echo "adapter=0 addr=0x50 len=16 read_pct=50" > /sys/kernel/debug/i2c-bench/run
+ *   cat /sys/kernel/debug/i2c-bench/run
+ *
+ * With several adapters every one is reported on its own, after the
+ * total. That doubles as a stress test of concurrent controllers:
+ *
+ *   echo "adapter=0 adapters=4 len=64 iterations=100000" > /sys/kernel/debug/i2c-bench/run
+ *
+ * Throughput counts payload bytes only. Latency is per i2c_transfer() call.
+ * CPU time is what the benchmarking task used plus the hard and soft
+ * interrupt time of all CPUs during the run; the latter is only exact with
+ * CONFIG_IRQ_TIME_ACCOUNTING.
+ *
+ * A run stops at the first failed transfer or on a fatal signal.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/i2c.h>
+#include <linux/kernel.h>
+#include <linux/kernel_stat.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "i2c-bench.h"
+
+#define I2C_BENCH_MAX_MSGS	32
+#define I2C_BENCH_MAX_LEN	65535
+#define I2C_BENCH_MAX_COMBO	32
+#define I2C_BENCH_MAX_ITER	1000000
+#define I2C_BENCH_MAX_ADAPTERS	8
+
+struct i2c_bench_cfg {
+	u32 adapter;
+	u32 addr;
+	u32 len;
+	u32 msgs;
+	u32 read_pct;
+	u32 combo;
+	u32 iterations;
+	u32 adapters;
+};
+
+struct i2c_bench_result {
+	int status;
+	u32 done;
+	u64 bytes;
+	u64 elapsed_ns;
+	u64 task_ns;
+	u64 irq_ns;
+	u64 min_ns, p50_ns, p99_ns, p999_ns, max_ns;
+};
+
+static DEFINE_MUTEX(i2c_bench_lock);
+static struct dentry *i2c_bench_debugfs;
+
+static struct i2c_bench_cfg i2c_bench_cfg = {
+	.addr = 0x50,
+	.len = 32,
+	.msgs = 1,
+	.iterations = 1000,
+	.adapters = 1,
+};
+
+static struct i2c_bench_result i2c_bench_result[I2C_BENCH_MAX_ADAPTERS] = {
+	[0 ... I2C_BENCH_MAX_ADAPTERS - 1] = { .status = -ENODATA },
+};
+static u32 i2c_bench_adapters;  /* in the last run */
+
+struct i2c_bench_worker {
+	const struct i2c_bench_cfg *cfg;
+	u32 nr;
+	struct i2c_bench_result *res;
+	struct completion done;
+};
+
+static int i2c_bench_set(struct i2c_bench_cfg *cfg, char *opt)
+{
+	static const struct {
+		const char *key;
+		size_t offset;
+		u32 min, max;
+	} keys[] = {
+		{ "adapter", offsetof(struct i2c_bench_cfg, adapter), 0, U32_MAX },
+		{ "addr", offsetof(struct i2c_bench_cfg, addr), 0, 0x7f },
+		{ "len", offsetof(struct i2c_bench_cfg, len), 1, I2C_BENCH_MAX_LEN },
+		{ "msgs", offsetof(struct i2c_bench_cfg, msgs), 1, I2C_BENCH_MAX_MSGS },
+		{ "read_pct", offsetof(struct i2c_bench_cfg, read_pct), 0, 100 },
+		{ "combo", offsetof(struct i2c_bench_cfg, combo), 0, I2C_BENCH_MAX_COMBO },
+		{ "iterations", offsetof(struct i2c_bench_cfg, iterations), 1, I2C_BENCH_MAX_ITER },
+		{ "adapters", offsetof(struct i2c_bench_cfg, adapters), 1, I2C_BENCH_MAX_ADAPTERS },
+	};
+	char *val = opt;
+	char *key = strsep(&val, "=");
+	unsigned int i;
+	u32 v;
+	int ret;
+
+	if (!val)
+		return -EINVAL;
+
+	for (i = 0; i < ARRAY_SIZE(keys); i++) {
+		if (strcmp(key, keys[i].key))
+			continue;
+		ret = kstrtou32(val, 0, &v);
+		if (ret)
+			return ret;
+		if (v < keys[i].min || v > keys[i].max)
+			return -ERANGE;
+		*(u32 *)((u8 *)cfg + keys[i].offset) = v;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static u64 i2c_bench_irq_time(void)
+{
+	u64 ns = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		ns += kcpustat_cpu(cpu).cpustat[CPUTIME_IRQ] +
+		      kcpustat_cpu(cpu).cpustat[CPUTIME_SOFTIRQ];
+
+	return ns;
+}
+
+/*
+ * Lay out the messages of one i2c_transfer() call. Reads and writes are
+ * spread evenly by carrying the read share over from message to message.
+ * Returns the number of messages.
+ */
+static int i2c_bench_build(const struct i2c_bench_cfg *cfg, struct i2c_msg *msgs,
+			   u8 *buf, u8 *combo_buf, unsigned int *carry)
+{
+	int i, n = 0;
+
+	for (i = 0; i < cfg->msgs; i++) {
+		bool rd;
+
+		*carry += cfg->read_pct;
+		rd = *carry >= 100;
+		if (rd)
+			*carry -= 100;
+
+		if (rd && cfg->combo) {
+			msgs[n].addr = cfg->addr;
+			msgs[n].flags = 0;
+			msgs[n].len = cfg->combo;
+			msgs[n].buf = combo_buf;
+			n++;
+		}
+
+		msgs[n].addr = cfg->addr;
+		msgs[n].flags = rd ? I2C_M_RD : 0;
+		msgs[n].len = cfg->len;
+		msgs[n].buf = buf + i * cfg->len;
+		n++;
+	}
+
+	return n;
+}
+
+static void i2c_bench_run(const struct i2c_bench_cfg *cfg, u32 nr,
+			  struct i2c_bench_result *res)
+{
+	struct i2c_adapter *adap;
+	struct i2c_msg *msgs;
+	u8 *buf, *combo_buf;
+	u64 *lat;
+	u64 task_start, irq_start;
+	ktime_t start, t;
+	unsigned int carry = 0;
+	int n, ret;
+	u32 i;
+
+	memset(res, 0, sizeof(*res));
+
+	adap = i2c_get_adapter(nr);
+	if (!adap) {
+		res->status = -ENODEV;
+		return;
+	}
+
+	msgs = kcalloc(2 * cfg->msgs, sizeof(*msgs), GFP_KERNEL);
+	buf = kvmalloc_array(cfg->msgs, cfg->len, GFP_KERNEL);
+	combo_buf = kzalloc(I2C_BENCH_MAX_COMBO, GFP_KERNEL);
+	lat = vmalloc(array_size(cfg->iterations, sizeof(*lat)));
+	if (!msgs || !buf || !combo_buf || !lat) {
+		res->status = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < cfg->msgs * cfg->len; i++)
+		buf[i] = i;
+
+	task_start = current->se.sum_exec_runtime;
+	irq_start = i2c_bench_irq_time();
+	start = ktime_get();
+
+	for (i = 0; i < cfg->iterations; i++) {
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		n = i2c_bench_build(cfg, msgs, buf, combo_buf, &carry);
+
+		t = ktime_get();
+		ret = i2c_transfer(adap, msgs, n);
+		lat[i] = ktime_to_ns(ktime_sub(ktime_get(), t));
+
+		if (ret != n) {
+			ret = ret < 0 ? ret : -EIO;
+			break;
+		}
+		res->bytes += (u64)cfg->len * cfg->msgs;
+		ret = 0;
+	}
+
+	res->elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	res->task_ns = current->se.sum_exec_runtime - task_start;
+	res->irq_ns = i2c_bench_irq_time() - irq_start;
+	res->status = ret;
+	res->done = i;
+
+	if (res->done) {
+		i2c_bench_sort(lat, res->done);
+		res->min_ns = lat[0];
+		res->p50_ns = i2c_bench_pct(lat, res->done, 500);
+		res->p99_ns = i2c_bench_pct(lat, res->done, 990);
+		res->p999_ns = i2c_bench_pct(lat, res->done, 999);
+		res->max_ns = lat[res->done - 1];
+	}
+
+out:
+	vfree(lat);
+	kfree(combo_buf);
+	kvfree(buf);
+	kfree(msgs);
+	i2c_put_adapter(adap);
+}
+
+static int i2c_bench_thread(void *data)
+{
+	struct i2c_bench_worker *w = data;
+
+	i2c_bench_run(w->cfg, w->nr, w->res);
+	complete(&w->done);
+
+	return 0;
+}
+
+/* One thread per adapter, spread over the online CPUs, all started together */
+static void i2c_bench_run_parallel(const struct i2c_bench_cfg *cfg,
+				   struct i2c_bench_result *res)
+{
+	struct i2c_bench_worker w[I2C_BENCH_MAX_ADAPTERS];
+	struct task_struct *task[I2C_BENCH_MAX_ADAPTERS];
+	int cpu = -1;
+	u32 i;
+
+	for (i = 0; i < cfg->adapters; i++) {
+		w[i].cfg = cfg;
+		w[i].nr = cfg->adapter + i;
+		w[i].res = &res[i];
+		init_completion(&w[i].done);
+
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+
+		task[i] = kthread_create(i2c_bench_thread, &w[i], "i2c-bench/%u", w[i].nr);
+		if (IS_ERR(task[i])) {
+			memset(&res[i], 0, sizeof(res[i]));
+			res[i].status = PTR_ERR(task[i]);
+			complete(&w[i].done);
+			continue;
+		}
+		kthread_bind(task[i], cpu);
+	}
+
+	for (i = 0; i < cfg->adapters; i++)
+		if (!IS_ERR(task[i]))
+			wake_up_process(task[i]);
+
+	for (i = 0; i < cfg->adapters; i++)
+		wait_for_completion(&w[i].done);
+}
+
+static void i2c_bench_show_result(struct seq_file *s, const struct i2c_bench_result *res)
+{
+	seq_printf(s, "status:       %d\n", res->status);
+	seq_printf(s, "transfers:    %u\n", res->done);
+	seq_printf(s, "bytes:        %llu\n", res->bytes);
+	seq_printf(s, "elapsed:      %llu us\n", div_u64(res->elapsed_ns, NSEC_PER_USEC));
+	if (res->elapsed_ns)
+		seq_printf(s, "throughput:   %llu B/s\n",
+			   div64_u64(res->bytes * NSEC_PER_SEC, res->elapsed_ns));
+	seq_printf(s, "latency min:  %llu ns\n", res->min_ns);
+	seq_printf(s, "latency p50:  %llu ns\n", res->p50_ns);
+	seq_printf(s, "latency p99:  %llu ns\n", res->p99_ns);
+	seq_printf(s, "latency p999: %llu ns\n", res->p999_ns);
+	seq_printf(s, "latency max:  %llu ns\n", res->max_ns);
+	seq_printf(s, "cpu task:     %llu us\n", div_u64(res->task_ns, NSEC_PER_USEC));
+	seq_printf(s, "cpu irq:      %llu us\n", div_u64(res->irq_ns, NSEC_PER_USEC));
+}
+
+static int i2c_bench_show(struct seq_file *s, void *unused)
+{
+	const struct i2c_bench_cfg *cfg = &i2c_bench_cfg;
+	const struct i2c_bench_result *res = i2c_bench_result;
+	u64 bytes = 0, elapsed_ns = 0;
+	int status = 0;
+	u32 i;
+
+	mutex_lock(&i2c_bench_lock);
+
+	seq_printf(s, "adapter=%u addr=0x%02x len=%u msgs=%u read_pct=%u combo=%u iterations=%u adapters=%u\n",
+		   cfg->adapter, cfg->addr, cfg->len, cfg->msgs, cfg->read_pct,
+		   cfg->combo, cfg->iterations, cfg->adapters);
+
+	if (res->status == -ENODATA) {
+		seq_puts(s, "no run yet\n");
+		goto out;
+	}
+
+	if (i2c_bench_adapters == 1) {
+		i2c_bench_show_result(s, res);
+		goto out;
+	}
+
+	for (i = 0; i < i2c_bench_adapters; i++) {
+		bytes += res[i].bytes;
+		elapsed_ns = max(elapsed_ns, res[i].elapsed_ns);
+		if (!status)
+			status = res[i].status;
+	}
+	seq_printf(s, "status:       %d\n", status);
+	seq_printf(s, "bytes:        %llu\n", bytes);
+	seq_printf(s, "elapsed:      %llu us\n", div_u64(elapsed_ns, NSEC_PER_USEC));
+	if (elapsed_ns)
+		seq_printf(s, "throughput:   %llu B/s\n", div64_u64(bytes * NSEC_PER_SEC, elapsed_ns));
+
+	for (i = 0; i < i2c_bench_adapters; i++) {
+		seq_printf(s, "\ni2c-%u:\n", cfg->adapter + i);
+		i2c_bench_show_result(s, &res[i]);
+	}
+
+out:
+	mutex_unlock(&i2c_bench_lock);
+	return 0;
+}
+
+static int i2c_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, i2c_bench_show, NULL);
+}
+
+static ssize_t i2c_bench_write(struct file *file, const char __user *ubuf,
+			       size_t count, loff_t *ppos)
+{
+	struct i2c_bench_cfg cfg;
+	char *kbuf, *p, *opt;
+	int ret = 0;
+
+	kbuf = memdup_user_nul(ubuf, min_t(size_t, count, PAGE_SIZE - 1));
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	mutex_lock(&i2c_bench_lock);
+
+	cfg = i2c_bench_cfg;
+	p = strim(kbuf);
+	while ((opt = strsep(&p, " \t\n")) != NULL) {
+		if (!*opt)
+			continue;
+		ret = i2c_bench_set(&cfg, opt);
+		if (ret)
+			goto out;
+	}
+
+	i2c_bench_cfg = cfg;
+	i2c_bench_adapters = cfg.adapters;
+	if (cfg.adapters == 1)
+		i2c_bench_run(&cfg, cfg.adapter, i2c_bench_result);
+	else
+		i2c_bench_run_parallel(&cfg, i2c_bench_result);
+
+out:
+	mutex_unlock(&i2c_bench_lock);
+	kfree(kbuf);
+
+	return ret ?: count;
+}
+
+static const struct file_operations i2c_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = i2c_bench_open,
+	.read = seq_read,
+	.write = i2c_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init i2c_bench_init(void)
+{
+	i2c_bench_debugfs = debugfs_create_dir("i2c-bench", NULL);
+	debugfs_create_file("run", 0600, i2c_bench_debugfs, NULL, &i2c_bench_fops);
+
+	return 0;
+}
+module_init(i2c_bench_init);
+
+static void __exit i2c_bench_exit(void)
+{
+	debugfs_remove_recursive(i2c_bench_debugfs);
+}
+module_exit(i2c_bench_exit);
+
+MODULE_AUTHOR("Sunplus Technology");
+MODULE_DESCRIPTION("I2C transfer throughput and latency benchmark");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Latency percentiles, shared by i2c-bench and the loopback self-test of
+ * the SP7021 I2C driver so both report the same figures.
+ */
+
+#ifndef __I2C_BENCH_H__
+#define __I2C_BENCH_H__
+
+#include <linux/math64.h>
+#include <linux/sort.h>
+#include <linux/types.h>
+
+static inline int i2c_bench_cmp(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static inline void i2c_bench_sort(u64 *lat, u32 n)
+{
+	sort(lat, n, sizeof(*lat), i2c_bench_cmp, NULL);
+}
+
+/* per mille of a sorted array, nearest rank */
+static inline u64 i2c_bench_pct(const u64 *lat, u32 n, unsigned int pm)
+{
+	return lat[div_u64((u64)(n - 1) * pm, 1000)];
+}
+
+#endif /* __I2C_BENCH_H__ */
@@ -5,9 +5,31 @@
  * Copyright (C) 2014 by Wolfram Sang, Sang Engineering <wsa@sang-engineering.com>
  * Copyright (C) 2014 by Renesas Electronics Corporation
  *
- * Because most slave IP cores can only detect one I2C slave address anyhow,
- * this driver does not support simulating EEPROM types which take more than
- * one address.
+ * EEPROM types which take more than one address (24c1024, 24m02) use the
+ * low slave address bits as block select. One slave is registered per block
+ * address; because most slave IP cores can only detect one I2C slave address
+ * anyhow, blocks the adapter refuses are only reachable through sysfs.
+ *
+ * Writes wrap within a page and start an internal write cycle (t_WR) at STOP,
+ * both taken from the type table. With the "nack-while-busy" property the
+ * simulated part NACKs its address until t_WR expires, like real 24Cxx parts
+ * do, so master-side acknowledge polling can be exercised.
+ *
+ * The slave is registered before its contents are known. A "firmware-name"
+ * image is loaded asynchronously and the array is populated lazily in chunks;
+ * until a chunk is loaded or written it reads back erased (0xff).
+ * "slave-eeprom-ready" in sysfs turns to 1 once loading has finished.
+ *
+ * "checksum-regions" lists <offset length crc-offset> triples. The backend
+ * owns the little-endian CRC32C field of each region and updates it
+ * incrementally from the changed bytes on every write, from the host or
+ * the bus, so covered fields never need a second write or a rescan.
+ * Stores through an mmap of slave-eeprom would bypass that, so with
+ * checksum regions it can only be mapped read-only.
+ *
+ * With debugfs, slave-eeprom-<dev>/heatmap holds a pair of u32 read and write
+ * counters per bucket of 2^bucket_shift bytes, counting master accesses only.
+ * Writing to heatmap clears it, writing bucket_shift re-buckets and clears.
  */
 
 /*
@@ -17,31 +39,230 @@
  */
 
 #include <linux/bitfield.h>
+#include <linux/bitmap.h>
+#include <linux/completion.h>
+#include <linux/crc32.h>
+#include <linux/debugfs.h>
 #include <linux/firmware.h>
+#include <linux/hrtimer.h>
 #include <linux/i2c.h>
 #include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/sysfs.h>
+#include <linux/vmalloc.h>
+#include <asm/unaligned.h>
+
+#define I2C_SLAVE_MAX_BLOCKS 4
+#define I2C_SLAVE_CHUNK_SHIFT 8
+#define I2C_SLAVE_CHUNK_SIZE BIT(I2C_SLAVE_CHUNK_SHIFT)
+#define I2C_SLAVE_MAX_CRC_REGIONS 8
+
+struct eeprom_crc_region {
+	u32 start;
+	u32 len;
+	u32 field;
+	u32 crc;
+};
 
 struct eeprom_data {
 	struct bin_attribute bin;
 	spinlock_t buffer_lock;
-	u16 buffer_idx;
-	u16 buffer_idx_r;
-	u16 address_mask;
+	u32 buffer_idx;
+	u32 buffer_idx_r;
+	u32 address_mask;
+	u32 page_mask;
+	u32 block_base;
+	u16 base_addr;
 	u8 num_address_bytes;
+	u8 num_blocks;
 	u8 idx_write_cnt;
 	bool read_only;
-	u8 buffer[];
+	bool nack_busy;
+	bool busy;
+	struct hrtimer write_timer;
+	ktime_t write_cycle;
+	struct i2c_client *block_client[I2C_SLAVE_MAX_BLOCKS];
+	struct completion loaded;
+	bool ready;
+	unsigned long *populated;
+	struct eeprom_crc_region *crc;
+	unsigned int num_crc;
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *debugfs;
+	u32 *heat;
+	unsigned int heat_shift;
+#endif
+	u8 *buffer;
 };
 
-#define I2C_SLAVE_BYTELEN GENMASK(15, 0)
-#define I2C_SLAVE_FLAG_ADDR16 BIT(16)
-#define I2C_SLAVE_FLAG_RO BIT(17)
+#define I2C_SLAVE_BYTELEN GENMASK(17, 0)
+#define I2C_SLAVE_FLAG_ADDR16 BIT(18)
+#define I2C_SLAVE_FLAG_RO BIT(19)
+#define I2C_SLAVE_PAGESHIFT GENMASK(23, 20)
+#define I2C_SLAVE_TWR_MS GENMASK(27, 24)
+#define I2C_SLAVE_BLOCKSHIFT GENMASK(29, 28)
 #define I2C_SLAVE_DEVICE_MAGIC(_len, _flags) ((_flags) | ((_len) - 1))
+/* page size in bytes (power of two) and internal write cycle time t_WR in ms */
+#define I2C_SLAVE_TIMING(_page, _twr) ((ilog2(_page) << 20) | ((_twr) << 24))
+/* number of slave addresses taken, the low address bits select the block */
+#define I2C_SLAVE_BLOCKS(_n) (ilog2(_n) << 28)
+
+/*
+ * Like the real parts, a write that runs past the end of a page wraps
+ * around to the start of that same page instead of spilling into the next.
+ */
+static inline unsigned int i2c_slave_eeprom_wr_offset(struct eeprom_data *eeprom)
+{
+	return (eeprom->block_base + (eeprom->buffer_idx & eeprom->page_mask)) &
+		eeprom->address_mask;
+}
+
+static inline unsigned int i2c_slave_eeprom_rd_offset(struct eeprom_data *eeprom)
+{
+	return (eeprom->block_base + eeprom->buffer_idx_r) & eeprom->address_mask;
+}
+
+/* Called with buffer_lock held */
+static inline u8 i2c_slave_eeprom_get(struct eeprom_data *eeprom, unsigned int off)
+{
+	if (!test_bit(off >> I2C_SLAVE_CHUNK_SHIFT, eeprom->populated))
+		return 0xff;
+
+	return eeprom->buffer[off];
+}
+
+/* Erase the chunks of [off, off + count) on first use. Called with buffer_lock held */
+static void i2c_slave_eeprom_populate(struct eeprom_data *eeprom, unsigned int off,
+				      size_t count)
+{
+	unsigned int chunk = off >> I2C_SLAVE_CHUNK_SHIFT;
+	unsigned int last;
+
+	if (!count)
+		return;
+
+	last = (off + count - 1) >> I2C_SLAVE_CHUNK_SHIFT;
+	for (; chunk <= last; chunk++) {
+		if (test_bit(chunk, eeprom->populated))
+			continue;
+		/* An empty eeprom typically has all bits set to 1 */
+		memset(&eeprom->buffer[chunk << I2C_SLAVE_CHUNK_SHIFT], 0xff,
+		       I2C_SLAVE_CHUNK_SIZE);
+		__set_bit(chunk, eeprom->populated);
+	}
+}
+
+/* Full CRC32C of a region, only needed once the image is known. Called with buffer_lock held */
+static void i2c_slave_eeprom_crc_init(struct eeprom_data *eeprom)
+{
+	struct eeprom_crc_region *r;
+
+	for (r = eeprom->crc; r < eeprom->crc + eeprom->num_crc; r++) {
+		i2c_slave_eeprom_populate(eeprom, r->start, r->len);
+		i2c_slave_eeprom_populate(eeprom, r->field, sizeof(u32));
+		r->crc = ~__crc32c_le(~0, &eeprom->buffer[r->start], r->len);
+		put_unaligned_le32(r->crc, &eeprom->buffer[r->field]);
+	}
+}
+
+/*
+ * CRCs are linear: for equal lengths crc(a) ^ crc(b) is the raw CRC of a ^ b.
+ * So the CRC of a region only needs the CRC of the changed span XORed with
+ * the old contents, moved past the rest of the region by a shift that is
+ * logarithmic in its length. Must run before the new bytes are copied in.
+ * Called with buffer_lock held.
+ */
+static void i2c_slave_eeprom_crc_update(struct eeprom_data *eeprom, unsigned int off,
+					const u8 *data, size_t count)
+{
+	struct eeprom_crc_region *r;
+	unsigned int start, end, i, n;
+	u8 delta[32];
+	u32 raw;
+
+	for (r = eeprom->crc; r < eeprom->crc + eeprom->num_crc; r++) {
+		start = max_t(unsigned int, off, r->start);
+		end = min_t(unsigned int, off + count, r->start + r->len);
+		if (start >= end)
+			continue;
+
+		raw = 0;
+		for (; start < end; start += n) {
+			n = min_t(unsigned int, end - start, sizeof(delta));
+			for (i = 0; i < n; i++)
+				delta[i] = eeprom->buffer[start + i] ^ data[start + i - off];
+			raw = __crc32c_le(raw, delta, n);
+		}
+		r->crc ^= __crc32c_le_shift(raw, r->start + r->len - end);
+	}
+}
+
+/* Called with buffer_lock held */
+static void i2c_slave_eeprom_write_locked(struct eeprom_data *eeprom, unsigned int off,
+					  const void *data, size_t count)
+{
+	struct eeprom_crc_region *r;
+
+	i2c_slave_eeprom_populate(eeprom, off, count);
+	i2c_slave_eeprom_crc_update(eeprom, off, data, count);
+	memcpy(&eeprom->buffer[off], data, count);
+
+	/* also restores a CRC field the write itself may have clobbered */
+	for (r = eeprom->crc; r < eeprom->crc + eeprom->num_crc; r++)
+		put_unaligned_le32(r->crc, &eeprom->buffer[r->field]);
+}
+
+#ifdef CONFIG_DEBUG_FS
+/*
+ * The bus callbacks already hold buffer_lock for every byte, so a plain
+ * increment in that section costs next to nothing and is never torn;
+ * per-CPU copies would only add folding work to the reader.
+ */
+static inline void i2c_slave_eeprom_count(struct eeprom_data *eeprom, unsigned int off,
+					  bool write)
+{
+	if (eeprom->heat)
+		eeprom->heat[2 * (off >> eeprom->heat_shift) + write]++;
+}
+#else
+static inline void i2c_slave_eeprom_count(struct eeprom_data *eeprom, unsigned int off,
+					  bool write)
+{
+}
+#endif
+
+/* The slave address the master used selects the block of the array */
+static void i2c_slave_eeprom_select_block(struct eeprom_data *eeprom,
+					  struct i2c_client *client)
+{
+	unsigned int block = (client->addr - eeprom->base_addr) & (eeprom->num_blocks - 1);
+
+	eeprom->block_base = block << (8 * eeprom->num_address_bytes);
+}
+
+static enum hrtimer_restart i2c_slave_eeprom_write_done(struct hrtimer *timer)
+{
+	struct eeprom_data *eeprom = container_of(timer, struct eeprom_data, write_timer);
+
+	WRITE_ONCE(eeprom->busy, false);
+
+	return HRTIMER_NORESTART;
+}
+
+/* The internal write cycle starts with the STOP that ends a write */
+static void i2c_slave_eeprom_start_write_cycle(struct eeprom_data *eeprom)
+{
+	if (!eeprom->write_cycle || !eeprom->buffer_idx)
+		return;
+
+	WRITE_ONCE(eeprom->busy, true);
+	hrtimer_start(&eeprom->write_timer, eeprom->write_cycle, HRTIMER_MODE_REL);
+}
 
 static int i2c_slave_eeprom_slave_cb(struct i2c_client *client,
 				     enum i2c_slave_event event, u8 *val)
@@ -95,7 +316,9 @@ static int i2c_slave_eeprom_slave_cb(struct i2c_client *client,
 	case I2C_SLAVE_WRITE_RECEIVED:
 		//printk("WRITE_RECEIVED          0x%x\n", *val);
 		spin_lock(&eeprom->buffer_lock);
-		eeprom->buffer[eeprom->buffer_idx++ & eeprom->address_mask] = *val;
+		i2c_slave_eeprom_write_locked(eeprom, i2c_slave_eeprom_wr_offset(eeprom), val, 1);
+		i2c_slave_eeprom_count(eeprom, i2c_slave_eeprom_wr_offset(eeprom), true);
+		eeprom->buffer_idx++;
 		spin_unlock(&eeprom->buffer_lock);
 		break;
 
@@ -105,22 +328,32 @@ static int i2c_slave_eeprom_slave_cb(struct i2c_client *client,
 		//printk("READ_PROCESSED          0x%x\n", *val);
 		/* The previous byte made it to the bus, get next one */
 		spin_lock(&eeprom->buffer_lock);
-		*val = eeprom->buffer[eeprom->buffer_idx_r++ & eeprom->address_mask];
+		*val = i2c_slave_eeprom_get(eeprom, i2c_slave_eeprom_rd_offset(eeprom));
+		i2c_slave_eeprom_count(eeprom, i2c_slave_eeprom_rd_offset(eeprom), false);
+		eeprom->buffer_idx_r++;
 		spin_unlock(&eeprom->buffer_lock);
 		break;
 		
 	case I2C_SLAVE_READ_REQUESTED:
 		//printk("READ_REQUESTED\n");
+		/* A part busy with its internal write cycle NACKs its address */
+		if (eeprom->nack_busy && READ_ONCE(eeprom->busy))
+			return -EBUSY;
+		i2c_slave_eeprom_select_block(eeprom, client);
 		eeprom->buffer_idx_r = 0;
 		break;
 
 	case I2C_SLAVE_WRITE_REQUESTED:
 		//printk("WRITE_REQUESTED\n");
+		if (eeprom->nack_busy && READ_ONCE(eeprom->busy))
+			return -EBUSY;
+		i2c_slave_eeprom_select_block(eeprom, client);
 		eeprom->buffer_idx = 0;
 		break;
 		
 	case I2C_SLAVE_STOP:
 		//printk("STOP\n");
+		i2c_slave_eeprom_start_write_cycle(eeprom);
 		eeprom->buffer_idx = 0;
 		eeprom->buffer_idx_r = 0;
 		break;
@@ -137,11 +370,19 @@ static ssize_t i2c_slave_eeprom_bin_read(struct file *filp, struct kobject *kobj
 {
 	struct eeprom_data *eeprom;
 	unsigned long flags;
+	size_t done, len;
 
 	eeprom = dev_get_drvdata(kobj_to_dev(kobj));
 
 	spin_lock_irqsave(&eeprom->buffer_lock, flags);
-	memcpy(buf, &eeprom->buffer[off], count);
+	for (done = 0; done < count; done += len, off += len) {
+		len = min_t(size_t, count - done,
+			    I2C_SLAVE_CHUNK_SIZE - (off & (I2C_SLAVE_CHUNK_SIZE - 1)));
+		if (test_bit(off >> I2C_SLAVE_CHUNK_SHIFT, eeprom->populated))
+			memcpy(buf + done, &eeprom->buffer[off], len);
+		else
+			memset(buf + done, 0xff, len);
+	}
 	spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
 
 	return count;
@@ -156,52 +397,402 @@ static ssize_t i2c_slave_eeprom_bin_write(struct file *filp, struct kobject *kob
 	eeprom = dev_get_drvdata(kobj_to_dev(kobj));
 
 	spin_lock_irqsave(&eeprom->buffer_lock, flags);
-	memcpy(&eeprom->buffer[off], buf, count);
+	i2c_slave_eeprom_write_locked(eeprom, off, buf, count);
 	spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
 
 	return count;
 }
 
-static int i2c_slave_init_eeprom_data(struct eeprom_data *eeprom, struct i2c_client *client,
-				      unsigned int size)
+static int i2c_slave_eeprom_bin_mmap(struct file *filp, struct kobject *kobj,
+		struct bin_attribute *attr, struct vm_area_struct *vma)
+{
+	struct eeprom_data *eeprom = dev_get_drvdata(kobj_to_dev(kobj));
+	unsigned long pages = PAGE_ALIGN(eeprom->bin.size) >> PAGE_SHIFT;
+	unsigned long flags, addr;
+	size_t off;
+	int ret;
+
+	if (vma->vm_pgoff > pages || vma_pages(vma) > pages - vma->vm_pgoff)
+		return -EINVAL;
+
+	/* stores through the mapping would not update the CRC fields */
+	if (eeprom->num_crc) {
+		if (vma->vm_flags & VM_WRITE)
+			return -EPERM;
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+
+	/*
+	 * A mapping bypasses the lazy accessors, so it needs the real contents.
+	 * Erase a page at a time so the bus never waits on more than that.
+	 */
+	for (off = 0; off < eeprom->bin.size; off += PAGE_SIZE) {
+		spin_lock_irqsave(&eeprom->buffer_lock, flags);
+		i2c_slave_eeprom_populate(eeprom, off,
+					  min_t(size_t, eeprom->bin.size - off, PAGE_SIZE));
+		spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
+		cond_resched();
+	}
+
+	/* plain vmalloc() memory, so insert the pages instead of remap_vmalloc_range() */
+	off = vma->vm_pgoff << PAGE_SHIFT;
+	for (addr = vma->vm_start; addr < vma->vm_end; addr += PAGE_SIZE, off += PAGE_SIZE) {
+		ret = vm_insert_page(vma, addr, vmalloc_to_page(eeprom->buffer + off));
+		if (ret)
+			return ret;
+	}
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+
+	return 0;
+}
+
+static ssize_t i2c_slave_eeprom_ready_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct eeprom_data *eeprom = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", READ_ONCE(eeprom->ready));
+}
+
+static struct device_attribute i2c_slave_eeprom_ready_attr = {
+	.attr = { .name = "slave-eeprom-ready", .mode = S_IRUGO },
+	.show = i2c_slave_eeprom_ready_show,
+};
+
+static void i2c_slave_eeprom_free_buffer(void *buffer)
+{
+	vfree(buffer);
+}
+
+static void i2c_slave_eeprom_set_ready(struct eeprom_data *eeprom, struct device *dev)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&eeprom->buffer_lock, flags);
+	i2c_slave_eeprom_crc_init(eeprom);
+	spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
+
+	WRITE_ONCE(eeprom->ready, true);
+	complete_all(&eeprom->loaded);
+	sysfs_notify(&dev->kobj, NULL, i2c_slave_eeprom_ready_attr.attr.name);
+}
+
+static void i2c_slave_eeprom_fw_loaded(const struct firmware *fw, void *context)
+{
+	struct i2c_client *client = context;
+	struct eeprom_data *eeprom = i2c_get_clientdata(client);
+	unsigned long flags;
+	size_t len, off, n;
+
+	if (!fw) {
+		dev_err(&client->dev, "loading the eeprom image failed, keeping it erased\n");
+		goto out;
+	}
+
+	len = min_t(size_t, fw->size, eeprom->bin.size);
+	spin_lock_irqsave(&eeprom->buffer_lock, flags);
+	/* Chunks a master or sysfs wrote while the image was loading keep their data */
+	for (off = 0; off < len; off += I2C_SLAVE_CHUNK_SIZE) {
+		n = min_t(size_t, len - off, I2C_SLAVE_CHUNK_SIZE);
+		if (test_bit(off >> I2C_SLAVE_CHUNK_SHIFT, eeprom->populated))
+			continue;
+		i2c_slave_eeprom_populate(eeprom, off, n);
+		memcpy(&eeprom->buffer[off], fw->data + off, n);
+	}
+	spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
+	release_firmware(fw);
+out:
+	i2c_slave_eeprom_set_ready(eeprom, &client->dev);
+}
+
+static void i2c_slave_init_eeprom_data(struct eeprom_data *eeprom, struct i2c_client *client)
 {
-	const struct firmware *fw;
 	const char *eeprom_data;
 	int ret = device_property_read_string(&client->dev, "firmware-name", &eeprom_data);
 
 	if (!ret) {
-		printk("<0>request_firmware_into_buf!\n");
-		ret = request_firmware_into_buf(&fw, eeprom_data, &client->dev,
-						eeprom->buffer, size);
-		if (ret)
-			return ret;
-		release_firmware(fw);
-	} else {
-		printk("<0>memset!\n");
-		/* An empty eeprom typically has all bits set to 1 */
-		memset(eeprom->buffer, 0xff, size);
+		ret = request_firmware_nowait(THIS_MODULE, FW_ACTION_HOTPLUG, eeprom_data,
+					      &client->dev, GFP_KERNEL, client,
+					      i2c_slave_eeprom_fw_loaded);
+		if (!ret)
+			return;
+		dev_err(&client->dev, "requesting %s failed: %d\n", eeprom_data, ret);
 	}
+	/* Nothing to load: every chunk reads back erased until it is written */
+	i2c_slave_eeprom_set_ready(eeprom, &client->dev);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static size_t i2c_slave_eeprom_heat_size(struct eeprom_data *eeprom, unsigned int shift)
+{
+	return 2 * sizeof(u32) * DIV_ROUND_UP(eeprom->bin.size, 1U << shift);
+}
+
+/* Swap in a cleared map with new bucketing; the old one is returned for freeing */
+static u32 *i2c_slave_eeprom_heat_rebucket(struct eeprom_data *eeprom, unsigned int shift)
+{
+	unsigned long flags;
+	u32 *heat, *old;
+
+	heat = kvzalloc(i2c_slave_eeprom_heat_size(eeprom, shift), GFP_KERNEL);
+	if (!heat)
+		return ERR_PTR(-ENOMEM);
+
+	spin_lock_irqsave(&eeprom->buffer_lock, flags);
+	old = eeprom->heat;
+	eeprom->heat = heat;
+	eeprom->heat_shift = shift;
+	spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
+
+	return old;
+}
+
+static ssize_t i2c_slave_eeprom_heat_read(struct file *file, char __user *ubuf,
+					  size_t count, loff_t *ppos)
+{
+	struct eeprom_data *eeprom = file->private_data;
+	unsigned int shift;
+	unsigned long flags;
+	size_t size;
+	ssize_t ret;
+	u32 *snap;
+
+retry:
+	shift = READ_ONCE(eeprom->heat_shift);
+	size = i2c_slave_eeprom_heat_size(eeprom, shift);
+	snap = kvmalloc(size, GFP_KERNEL);
+	if (!snap)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&eeprom->buffer_lock, flags);
+	if (eeprom->heat_shift != shift) {
+		/* re-bucketed while we allocated */
+		spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
+		kvfree(snap);
+		goto retry;
+	}
+	memcpy(snap, eeprom->heat, size);
+	spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
+
+	ret = simple_read_from_buffer(ubuf, count, ppos, snap, size);
+	kvfree(snap);
+
+	return ret;
+}
+
+static ssize_t i2c_slave_eeprom_heat_write(struct file *file, const char __user *ubuf,
+					   size_t count, loff_t *ppos)
+{
+	struct eeprom_data *eeprom = file->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&eeprom->buffer_lock, flags);
+	memset(eeprom->heat, 0, i2c_slave_eeprom_heat_size(eeprom, eeprom->heat_shift));
+	spin_unlock_irqrestore(&eeprom->buffer_lock, flags);
+
+	return count;
+}
+
+static const struct file_operations i2c_slave_eeprom_heat_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = i2c_slave_eeprom_heat_read,
+	.write = i2c_slave_eeprom_heat_write,
+	.llseek = default_llseek,
+};
+
+static int i2c_slave_eeprom_shift_get(void *data, u64 *val)
+{
+	struct eeprom_data *eeprom = data;
+
+	*val = eeprom->heat_shift;
 	return 0;
 }
 
+static int i2c_slave_eeprom_shift_set(void *data, u64 val)
+{
+	struct eeprom_data *eeprom = data;
+	u32 *old;
+
+	if (val > ilog2(eeprom->bin.size))
+		return -EINVAL;
+
+	old = i2c_slave_eeprom_heat_rebucket(eeprom, val);
+	if (IS_ERR(old))
+		return PTR_ERR(old);
+
+	kvfree(old);
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(i2c_slave_eeprom_shift_fops, i2c_slave_eeprom_shift_get,
+			 i2c_slave_eeprom_shift_set, "%llu\n");
+
+static void i2c_slave_eeprom_debugfs_init(struct eeprom_data *eeprom, struct i2c_client *client)
+{
+	char name[32];
+	u32 *old;
+
+	/* about a thousand buckets by default, per byte for the small parts */
+	old = i2c_slave_eeprom_heat_rebucket(eeprom, max(ilog2(eeprom->bin.size) - 10, 0));
+	if (IS_ERR(old))
+		return;
+
+	snprintf(name, sizeof(name), "slave-eeprom-%s", dev_name(&client->dev));
+	eeprom->debugfs = debugfs_create_dir(name, NULL);
+	debugfs_create_file("heatmap", S_IRUSR | S_IWUSR, eeprom->debugfs, eeprom,
+			    &i2c_slave_eeprom_heat_fops);
+	debugfs_create_file_unsafe("bucket_shift", S_IRUSR | S_IWUSR, eeprom->debugfs, eeprom,
+				   &i2c_slave_eeprom_shift_fops);
+}
+
+static void i2c_slave_eeprom_debugfs_exit(struct eeprom_data *eeprom)
+{
+	debugfs_remove_recursive(eeprom->debugfs);
+	kvfree(eeprom->heat);
+}
+#else
+static void i2c_slave_eeprom_debugfs_init(struct eeprom_data *eeprom, struct i2c_client *client)
+{
+}
+
+static void i2c_slave_eeprom_debugfs_exit(struct eeprom_data *eeprom)
+{
+}
+#endif
+
+static int i2c_slave_eeprom_parse_crc(struct eeprom_data *eeprom, struct device *dev,
+				     unsigned int size)
+{
+	struct eeprom_crc_region *r;
+	u32 cells[I2C_SLAVE_MAX_CRC_REGIONS * 3];
+	int i, n, ret;
+
+	n = device_property_count_u32(dev, "checksum-regions");
+	if (n <= 0)
+		return 0;
+	if (n % 3 || n > ARRAY_SIZE(cells)) {
+		dev_err(dev, "checksum-regions: expected up to %d <offset length crc-offset> triples\n",
+			I2C_SLAVE_MAX_CRC_REGIONS);
+		return -EINVAL;
+	}
+
+	ret = device_property_read_u32_array(dev, "checksum-regions", cells, n);
+	if (ret)
+		return ret;
+
+	eeprom->num_crc = n / 3;
+	eeprom->crc = devm_kcalloc(dev, eeprom->num_crc, sizeof(*eeprom->crc), GFP_KERNEL);
+	if (!eeprom->crc)
+		return -ENOMEM;
+
+	for (i = 0; i < eeprom->num_crc; i++) {
+		r = &eeprom->crc[i];
+		r->start = cells[3 * i];
+		r->len = cells[3 * i + 1];
+		r->field = cells[3 * i + 2];
+
+		if (!r->len || r->start >= size || r->len > size - r->start ||
+		    r->field > size - sizeof(u32) ||
+		    (r->field < r->start + r->len && r->field + sizeof(u32) > r->start)) {
+			dev_err(dev, "checksum region %d is invalid\n", i);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Blocks 1..n answer at the following slave addresses. An adapter that can
+ * only detect one address refuses them; that is not fatal, the blocks stay
+ * reachable through sysfs.
+ */
+static void i2c_slave_eeprom_register_blocks(struct eeprom_data *eeprom,
+					     struct i2c_client *client)
+{
+	struct i2c_client *dummy;
+	int i, ret;
+
+	for (i = 1; i < eeprom->num_blocks; i++) {
+		dummy = devm_i2c_new_dummy_device(&client->dev, client->adapter,
+						  client->addr + i);
+		if (IS_ERR(dummy)) {
+			dev_warn(&client->dev, "block %d: no address 0x%02x: %ld\n",
+				 i, client->addr + i, PTR_ERR(dummy));
+			continue;
+		}
+
+		i2c_set_clientdata(dummy, eeprom);
+		ret = i2c_slave_register(dummy, i2c_slave_eeprom_slave_cb);
+		if (ret) {
+			dev_warn(&client->dev, "block %d not reachable on the bus: %d\n",
+				 i, ret);
+			continue;
+		}
+		eeprom->block_client[i] = dummy;
+	}
+}
+
+static void i2c_slave_eeprom_unregister_blocks(struct eeprom_data *eeprom)
+{
+	int i;
+
+	for (i = 1; i < eeprom->num_blocks; i++)
+		if (eeprom->block_client[i])
+			i2c_slave_unregister(eeprom->block_client[i]);
+}
+
 static int i2c_slave_eeprom_probe(struct i2c_client *client, const struct i2c_device_id *id)
 {
 	struct eeprom_data *eeprom;
 	int ret;
 	unsigned int size = FIELD_GET(I2C_SLAVE_BYTELEN, id->driver_data) + 1;//len 256
 	unsigned int flag_addr16 = FIELD_GET(I2C_SLAVE_FLAG_ADDR16, id->driver_data);
+	unsigned int page_shift = FIELD_GET(I2C_SLAVE_PAGESHIFT, id->driver_data);
+	unsigned int twr_ms = FIELD_GET(I2C_SLAVE_TWR_MS, id->driver_data);
+	unsigned int block_shift = FIELD_GET(I2C_SLAVE_BLOCKSHIFT, id->driver_data);
 
-	eeprom = devm_kzalloc(&client->dev, sizeof(struct eeprom_data) + size, GFP_KERNEL);
+	eeprom = devm_kzalloc(&client->dev, sizeof(struct eeprom_data), GFP_KERNEL);
 	if (!eeprom)
 		return -ENOMEM;
 
+	/*
+	 * up to 256 KiB: keep it out of the slab, and page aligned for mmap.
+	 * Not zeroed, the populated bitmap says which chunks hold data; only
+	 * the tail of a sub-page part would reach user space uninitialised.
+	 */
+	eeprom->buffer = vmalloc(size);
+	if (!eeprom->buffer)
+		return -ENOMEM;
+	memset(eeprom->buffer + size, 0, PAGE_ALIGN(size) - size);
+
+	ret = devm_add_action_or_reset(&client->dev, i2c_slave_eeprom_free_buffer,
+				       eeprom->buffer);
+	if (ret)
+		return ret;
+
+	eeprom->populated = devm_kcalloc(&client->dev,
+					 BITS_TO_LONGS(DIV_ROUND_UP(size, I2C_SLAVE_CHUNK_SIZE)),
+					 sizeof(unsigned long), GFP_KERNEL);
+	if (!eeprom->populated)
+		return -ENOMEM;
+
 	eeprom->num_address_bytes = flag_addr16 ? 2 : 1;
+	eeprom->num_blocks = BIT(block_shift);
+	eeprom->base_addr = client->addr;
 	eeprom->address_mask = size - 1;//0xff 
 	eeprom->read_only = FIELD_GET(I2C_SLAVE_FLAG_RO, id->driver_data);
+	/* no page size in the table means the whole array is one page */
+	eeprom->page_mask = page_shift ? BIT(page_shift) - 1 : eeprom->address_mask;
+	eeprom->write_cycle = ms_to_ktime(twr_ms);
+	eeprom->nack_busy = device_property_read_bool(&client->dev, "nack-while-busy");
+	hrtimer_init(&eeprom->write_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	eeprom->write_timer.function = i2c_slave_eeprom_write_done;
 	spin_lock_init(&eeprom->buffer_lock);
+	init_completion(&eeprom->loaded);
 	i2c_set_clientdata(client, eeprom);
 
-	ret = i2c_slave_init_eeprom_data(eeprom, client, size);
+	ret = i2c_slave_eeprom_parse_crc(eeprom, &client->dev, size);
 	if (ret)
 		return ret;
 
@@ -210,40 +801,65 @@ static int i2c_slave_eeprom_probe(struct i2c_client *client, const struct i2c_de
 	eeprom->bin.attr.mode = S_IRUSR | S_IWUSR;
 	eeprom->bin.read = i2c_slave_eeprom_bin_read;
 	eeprom->bin.write = i2c_slave_eeprom_bin_write;
+	eeprom->bin.mmap = i2c_slave_eeprom_bin_mmap;
 	eeprom->bin.size = size;
 
 	ret = sysfs_create_bin_file(&client->dev.kobj, &eeprom->bin);
 	if (ret)
 		return ret;
 
+	ret = device_create_file(&client->dev, &i2c_slave_eeprom_ready_attr);
+	if (ret)
+		goto err_remove_bin;
+
+	i2c_slave_eeprom_debugfs_init(eeprom, client);
+
 	ret = i2c_slave_register(client, i2c_slave_eeprom_slave_cb);//
-	if (ret) {
-		sysfs_remove_bin_file(&client->dev.kobj, &eeprom->bin);
-		return ret;
-	}
+	if (ret)
+		goto err_remove_debugfs;
+
+	i2c_slave_eeprom_register_blocks(eeprom, client);
+	i2c_slave_init_eeprom_data(eeprom, client);
 
 	return 0;
+
+err_remove_debugfs:
+	i2c_slave_eeprom_debugfs_exit(eeprom);
+	device_remove_file(&client->dev, &i2c_slave_eeprom_ready_attr);
+err_remove_bin:
+	sysfs_remove_bin_file(&client->dev.kobj, &eeprom->bin);
+	return ret;
 };
 
 static int i2c_slave_eeprom_remove(struct i2c_client *client)
 {
 	struct eeprom_data *eeprom = i2c_get_clientdata(client);
 
+	/* the image loader still holds a reference to eeprom */
+	wait_for_completion(&eeprom->loaded);
+	i2c_slave_eeprom_unregister_blocks(eeprom);
 	i2c_slave_unregister(client);
+	hrtimer_cancel(&eeprom->write_timer);
+	i2c_slave_eeprom_debugfs_exit(eeprom);
+	device_remove_file(&client->dev, &i2c_slave_eeprom_ready_attr);
 	sysfs_remove_bin_file(&client->dev.kobj, &eeprom->bin);
 
 	return 0;
 }
 
 static const struct i2c_device_id i2c_slave_eeprom_id[] = {
-	{ "slave-24c02", I2C_SLAVE_DEVICE_MAGIC(2048 / 8,  0) },
+	{ "slave-24c02", I2C_SLAVE_DEVICE_MAGIC(2048 / 8,  I2C_SLAVE_TIMING(8, 5)) },
 	{ "slave-24c02ro", I2C_SLAVE_DEVICE_MAGIC(2048 / 8,  I2C_SLAVE_FLAG_RO) },
-	{ "slave-24c32", I2C_SLAVE_DEVICE_MAGIC(32768 / 8, I2C_SLAVE_FLAG_ADDR16) },
+	{ "slave-24c32", I2C_SLAVE_DEVICE_MAGIC(32768 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_TIMING(32, 5)) },
 	{ "slave-24c32ro", I2C_SLAVE_DEVICE_MAGIC(32768 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_FLAG_RO) },
-	{ "slave-24c64", I2C_SLAVE_DEVICE_MAGIC(65536 / 8, I2C_SLAVE_FLAG_ADDR16) },
+	{ "slave-24c64", I2C_SLAVE_DEVICE_MAGIC(65536 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_TIMING(32, 5)) },
 	{ "slave-24c64ro", I2C_SLAVE_DEVICE_MAGIC(65536 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_FLAG_RO) },
-	{ "slave-24c512", I2C_SLAVE_DEVICE_MAGIC(524288 / 8, I2C_SLAVE_FLAG_ADDR16) },
+	{ "slave-24c512", I2C_SLAVE_DEVICE_MAGIC(524288 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_TIMING(128, 5)) },
 	{ "slave-24c512ro", I2C_SLAVE_DEVICE_MAGIC(524288 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_FLAG_RO) },
+	{ "slave-24c1024", I2C_SLAVE_DEVICE_MAGIC(1048576 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_BLOCKS(2) | I2C_SLAVE_TIMING(256, 5)) },
+	{ "slave-24c1024ro", I2C_SLAVE_DEVICE_MAGIC(1048576 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_BLOCKS(2) | I2C_SLAVE_FLAG_RO) },
+	{ "slave-24m02", I2C_SLAVE_DEVICE_MAGIC(2097152 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_BLOCKS(4) | I2C_SLAVE_TIMING(256, 10)) },
+	{ "slave-24m02ro", I2C_SLAVE_DEVICE_MAGIC(2097152 / 8, I2C_SLAVE_FLAG_ADDR16 | I2C_SLAVE_BLOCKS(4) | I2C_SLAVE_FLAG_RO) },
 	{ }
 };
 MODULE_DEVICE_TABLE(i2c, i2c_slave_eeprom_id);
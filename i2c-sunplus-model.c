@@ -0,0 +1,761 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Software model of the SP7021 I2C master (I2CM) block
+ *
+ * Copyright (c) 2021 Sunplus Inc.
+ *
+ * Registers "sp7021-i2cm" platform devices whose register file lives in
+ * memory, so the unmodified transfer logic of i2c-sunplus.c runs on any
+ * machine. The driver has to be built with CONFIG_I2C_SUNPLUS_MODEL so its
+ * register accesses are routed through sp_i2cm_model_readl()/writel().
+ *
+ * The model covers the control registers, the 32 byte data FIFO with its
+ * empty threshold, the per-byte burst read flags (i2cm_status3) and their
+ * overflow flags (i2cm_status4), the DMA engine and the interrupt line,
+ * raised through an interrupt simulator domain so it is counted and handled
+ * like a real one. Bus time advances in hrtimer steps of one byte, derived
+ * from the programmed divider and SCL delay, or byte_ns when that is set.
+ *
+ * The bus carries a single memory-like target at every address but
+ * nack_addr: a write stores its bytes from offset 0 and a read returns them
+ * from offset 0, like the slave-eeprom loopback.
+ *
+ * DMA addresses are taken as physical addresses, which holds for the direct
+ * mapping the model device gets without an IOMMU.
+ *
+ * debugfs sp_i2cm_model/i2cm<N> reports the register accesses, interrupts
+ * and bus bytes the driver needed since the last write to the file, so the
+ * cost of the transfer paths per byte can be tracked. The driver reads the
+ * same counters through sp_i2cm_model_counters() for its own self-checks.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/dma-mapping.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/irq.h>
+#include <linux/irq_sim.h>
+#include <linux/irqdomain.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/rcupdate.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+
+#include "i2c-sunplus.h"
+
+#define SP_I2CM_MODEL_MAX        4
+#define SP_I2CM_MODEL_CLK_KHZ    27000
+#define SP_I2CM_MODEL_FIFO_BYTES 32
+#define SP_I2CM_MODEL_FIFO_WORDS (SP_I2CM_MODEL_FIFO_BYTES / 4)
+#define SP_I2CM_MODEL_MEM_SIZE   (I2C_CTL7_RW_COUNT_MASK + 1)
+#define SP_I2CM_MODEL_VERSION    0x00007021
+
+#define SP_I2CM_REG(field)       (offsetof(struct regs_i2cm_s, field) / sizeof(u32))
+#define SP_I2CM_DMA_REG(field)   (offsetof(struct regs_i2cm_dma_s, field) / sizeof(u32))
+
+static unsigned int instances = 1;
+module_param(instances, uint, 0444);
+MODULE_PARM_DESC(instances, "number of modelled controllers (1-4)");
+
+static unsigned int first_nr;
+module_param(first_nr, uint, 0444);
+MODULE_PARM_DESC(first_nr, "adapter number of the first modelled controller");
+
+static unsigned short nack_addr = 0xffff;
+module_param(nack_addr, ushort, 0644);
+MODULE_PARM_DESC(nack_addr, "7-bit address that NACKs, none by default");
+
+static unsigned int byte_ns;
+module_param(byte_ns, uint, 0644);
+MODULE_PARM_DESC(byte_ns, "bus time of one byte in ns, 0 to derive it from the programmed timing");
+
+enum sp_i2cm_model_phase {
+	SP_MODEL_IDLE,
+	SP_MODEL_ADDR,
+	SP_MODEL_WRITE,
+	SP_MODEL_RESTART,
+	SP_MODEL_READ,
+};
+
+struct sp_i2cm_model {
+	/* what the driver maps */
+	struct regs_i2cm_s regs;
+	struct regs_i2cm_dma_s dma;
+
+	spinlock_t lock;
+	struct hrtimer timer;
+	struct platform_device *pdev;
+	struct irq_domain *irq_domain;
+	int irq;
+	bool irq_level;
+
+	/* bus engine */
+	enum sp_i2cm_model_phase phase;
+	bool dma_mode;
+	bool restart;
+	bool read;
+	u8 *dma_buf;
+	unsigned int wr_total, wr_done;
+	unsigned int rd_total, rd_done;
+	u8 fifo[SP_I2CM_MODEL_FIFO_BYTES];
+	unsigned int fifo_words;     /* words queued for the bus */
+	unsigned int fifo_push;      /* word a data00_03 push lands in */
+	unsigned int fifo_pos;       /* byte the bus is at */
+
+	/* the target */
+	u8 *mem;
+	unsigned int mem_pos;
+
+	/* cost accounting */
+	u64 nr_reads;
+	u64 nr_writes;
+	u64 nr_irqs;
+	u64 nr_xfers;
+	u64 nr_bytes;
+};
+
+/*
+ * Looked up on every register access of every adapter, under RCU. Only
+ * module init and exit change it, an instance is freed after a grace period.
+ */
+static struct sp_i2cm_model __rcu *sp_i2cm_models[SP_I2CM_MODEL_MAX];
+static struct dentry *sp_i2cm_model_debugfs;
+
+static unsigned int sp_i2cm_model_reg(const volatile void __iomem *addr, const void *base)
+{
+	return ((const u8 __force *)addr - (const u8 *)base) / sizeof(u32);
+}
+
+/* Map control1/int_en0 bit positions onto the interrupt flag layout */
+static u32 sp_i2cm_model_ctl1_to_flags(u32 ctl1)
+{
+	u32 flags = ctl1 & GENMASK(7, 0);
+
+	if (ctl1 & I2C_CTL1_SCL_HOLD_TOO_LONG_CLR)
+		flags |= I2C_INT_SCL_HOLD_TOO_LONG_FLAG;
+	if (ctl1 & I2C_CTL1_EMPTY_CLR)
+		flags |= I2C_INT_EMPTY_FLAG;
+	return flags;
+}
+
+static u32 sp_i2cm_model_en0_to_flags(u32 en0)
+{
+	u32 flags = en0 & GENMASK(8, 0);
+
+	if (en0 & I2C_EN0_SCL_HOLD_TOO_LONG_INT)
+		flags |= I2C_INT_SCL_HOLD_TOO_LONG_FLAG;
+	if (en0 & I2C_EN0_NACK_INT)
+		flags |= I2C_INT_ADDRESS_NACK_FLAG | I2C_INT_DATA_NACK_FLAG;
+	return flags;
+}
+
+/*
+ * The line is level triggered. irq_sim only knows edges, so it is fired on a
+ * rising level and again whenever the driver acknowledges something while
+ * the level stays up, which is when real hardware would re-enter.
+ */
+static void sp_i2cm_model_update_irq(struct sp_i2cm_model *m, bool ack)
+{
+	struct regs_i2cm_s *r = &m->regs;
+	bool level;
+
+	level = (r->interrupt & sp_i2cm_model_en0_to_flags(r->int_en0)) ||
+		(r->i2cm_status3 & r->int_en1) ||
+		(r->i2cm_status4 & r->int_en2) ||
+		(m->dma.int_flag & m->dma.int_en);
+
+	if (level && (!m->irq_level || ack)) {
+		irq_set_irqchip_state(m->irq, IRQCHIP_STATE_PENDING, true);
+		m->nr_irqs++;
+	}
+	m->irq_level = level;
+}
+
+static void sp_i2cm_model_stop(struct sp_i2cm_model *m)
+{
+	m->phase = SP_MODEL_IDLE;
+	hrtimer_try_to_cancel(&m->timer);
+}
+
+static void sp_i2cm_model_reset(struct sp_i2cm_model *m)
+{
+	struct regs_i2cm_s *r = &m->regs;
+
+	sp_i2cm_model_stop(m);
+	r->interrupt = 0;
+	r->i2cm_status3 = 0;
+	r->i2cm_status4 = 0;
+	r->i2cm_mode &= ~I2C_MODE_MANUAL_TRIG;
+	m->fifo_words = 0;
+	m->fifo_push = 0;
+	m->fifo_pos = 0;
+}
+
+/* One byte on the bus: 9 SCL periods plus the programmed SCL delay */
+static ktime_t sp_i2cm_model_byte_time(struct sp_i2cm_model *m)
+{
+	unsigned int div = (m->regs.control2 & I2C_CTL2_FREQ_CUSTOM_MASK) + 1;
+	unsigned int delay = (m->regs.control2 >> 24) & I2C_CTL2_SCL_DELAY_MASK;
+	u64 ns = READ_ONCE(byte_ns);
+
+	if (ns)
+		return ns_to_ktime(ns);
+
+	ns = div_u64(9ULL * NSEC_PER_MSEC * div, SP_I2CM_MODEL_CLK_KHZ);
+	ns += div_u64(9ULL * NSEC_PER_MSEC * delay, SP_I2CM_MODEL_CLK_KHZ);
+
+	return ns_to_ktime(ns);
+}
+
+static void sp_i2cm_model_start(struct sp_i2cm_model *m)
+{
+	struct regs_i2cm_s *r = &m->regs;
+	u32 ctl7 = r->control7;
+
+	m->dma_mode = r->i2cm_mode & I2C_MODE_DMA_MODE;
+	m->restart = r->control0 & I2C_CTL0_RESTART_EN;
+	m->read = !m->restart && (r->control0 & I2C_CTL0_PREFETCH);
+	m->wr_total = m->read ? 0 : ctl7 & I2C_CTL7_RW_COUNT_MASK;
+	m->rd_total = m->restart || m->read ? (ctl7 >> 16) & I2C_CTL7_RW_COUNT_MASK : 0;
+	m->wr_done = 0;
+	m->rd_done = 0;
+	m->dma_buf = NULL;
+
+	if (m->dma_mode) {
+		m->dma_buf = phys_to_virt(m->dma.dma_addr);
+		/* the DMA engine's length wins over the counts in control7 */
+		if (m->read || m->restart)
+			m->rd_total = m->dma.dma_length & I2C_CTL7_RW_COUNT_MASK;
+		else
+			m->wr_total = m->dma.dma_length & I2C_CTL7_RW_COUNT_MASK;
+	}
+
+	/* the preloaded data registers are the first words of the FIFO */
+	m->fifo_words = min_t(unsigned int, SP_I2CM_MODEL_FIFO_WORDS,
+			      DIV_ROUND_UP(m->wr_total, 4));
+	m->fifo_push = m->fifo_words % SP_I2CM_MODEL_FIFO_WORDS;
+	m->fifo_pos = 0;
+
+	m->phase = SP_MODEL_ADDR;
+	m->nr_xfers++;
+	hrtimer_start(&m->timer, sp_i2cm_model_byte_time(m), HRTIMER_MODE_REL);
+}
+
+static void sp_i2cm_model_finish(struct sp_i2cm_model *m)
+{
+	m->regs.interrupt |= I2C_INT_DONE_FLAG;
+	if (m->dma_mode)
+		m->dma.int_flag |= I2C_DMA_INT_DMA_DONE_FLAG;
+	m->regs.i2cm_mode &= ~I2C_MODE_MANUAL_TRIG;
+	m->phase = SP_MODEL_IDLE;
+}
+
+static bool sp_i2cm_model_write_byte(struct sp_i2cm_model *m)
+{
+	struct regs_i2cm_s *r = &m->regs;
+	unsigned int threshold;
+	u8 byte;
+
+	if (m->dma_mode && !m->restart) {
+		byte = m->dma_buf[m->wr_done];
+	} else {
+		if (!m->fifo_words) {
+			r->interrupt |= I2C_INT_EMPTY_FLAG;
+			return false;
+		}
+		byte = m->fifo[m->fifo_pos];
+		m->fifo_pos = (m->fifo_pos + 1) % SP_I2CM_MODEL_FIFO_BYTES;
+		if (!(m->fifo_pos % 4))
+			m->fifo_words--;
+
+		threshold = (r->int_en0 >> 9) & I2C_EN0_CTL_EMPTY_THRESHOLD_MASK;
+		if (SP_I2CM_MODEL_FIFO_WORDS - m->fifo_words >= threshold)
+			r->interrupt |= I2C_INT_EMPTY_THRESHOLD_FLAG;
+	}
+
+	if (m->wr_done == 0)
+		m->mem_pos = 0;
+	m->mem[m->mem_pos++ % SP_I2CM_MODEL_MEM_SIZE] = byte;
+	m->wr_done++;
+	m->nr_bytes++;
+
+	return true;
+}
+
+static void sp_i2cm_model_read_byte(struct sp_i2cm_model *m)
+{
+	struct regs_i2cm_s *r = &m->regs;
+	unsigned int pos = m->rd_done % SP_I2CM_MODEL_FIFO_BYTES;
+	u8 byte;
+
+	if (m->rd_done == 0)
+		m->mem_pos = 0;
+	byte = m->mem[m->mem_pos++ % SP_I2CM_MODEL_MEM_SIZE];
+
+	if (m->dma_mode) {
+		m->dma_buf[m->rd_done] = byte;
+	} else {
+		/* the driver has not fetched this byte from the last lap yet */
+		if (r->i2cm_status3 & BIT(pos))
+			r->i2cm_status4 |= BIT(pos);
+		m->fifo[pos] = byte;
+		r->i2cm_status3 |= BIT(pos);
+	}
+	m->rd_done++;
+	m->nr_bytes++;
+}
+
+static enum hrtimer_restart sp_i2cm_model_tick(struct hrtimer *timer)
+{
+	struct sp_i2cm_model *m = container_of(timer, struct sp_i2cm_model, timer);
+	unsigned int addr;
+	unsigned long flags;
+
+	spin_lock_irqsave(&m->lock, flags);
+
+	switch (m->phase) {
+	case SP_MODEL_ADDR:
+		addr = (m->regs.control0 >> 1) & I2C_CTL0_SLAVE_ADDR_MASK;
+		if (addr == nack_addr) {
+			m->regs.interrupt |= I2C_INT_ADDRESS_NACK_FLAG;
+			m->phase = SP_MODEL_IDLE;
+			break;
+		}
+		m->phase = m->wr_total ? SP_MODEL_WRITE :
+			   m->rd_total ? SP_MODEL_READ : SP_MODEL_IDLE;
+		if (m->phase == SP_MODEL_IDLE)
+			sp_i2cm_model_finish(m);
+		break;
+
+	case SP_MODEL_WRITE:
+		if (!sp_i2cm_model_write_byte(m)) {
+			m->phase = SP_MODEL_IDLE;
+			break;
+		}
+		if (m->wr_done < m->wr_total)
+			break;
+		if (m->rd_total)
+			m->phase = SP_MODEL_RESTART;
+		else
+			sp_i2cm_model_finish(m);
+		break;
+
+	case SP_MODEL_RESTART:
+		/* repeated start and the address again */
+		m->phase = SP_MODEL_READ;
+		break;
+
+	case SP_MODEL_READ:
+		sp_i2cm_model_read_byte(m);
+		if (m->rd_done == m->rd_total)
+			sp_i2cm_model_finish(m);
+		break;
+
+	default:
+		break;
+	}
+
+	sp_i2cm_model_update_irq(m, false);
+
+	if (m->phase != SP_MODEL_IDLE)
+		hrtimer_forward_now(timer, sp_i2cm_model_byte_time(m));
+
+	spin_unlock_irqrestore(&m->lock, flags);
+
+	return m->phase != SP_MODEL_IDLE ? HRTIMER_RESTART : HRTIMER_NORESTART;
+}
+
+/* Called under rcu_read_lock(), the instance stays valid until the unlock */
+static struct sp_i2cm_model *sp_i2cm_model_find(const volatile void *addr, bool *dma)
+{
+	struct sp_i2cm_model *m;
+	int i;
+
+	for (i = 0; i < SP_I2CM_MODEL_MAX; i++) {
+		m = rcu_dereference(sp_i2cm_models[i]);
+		if (!m)
+			continue;
+		if ((void *)addr >= (void *)&m->regs && (void *)addr < (void *)(&m->regs + 1)) {
+			*dma = false;
+			return m;
+		}
+		if ((void *)addr >= (void *)&m->dma && (void *)addr < (void *)(&m->dma + 1)) {
+			*dma = true;
+			return m;
+		}
+	}
+
+	return NULL;
+}
+
+u32 sp_i2cm_model_readl(const volatile void __iomem *addr)
+{
+	struct sp_i2cm_model *m;
+	unsigned int reg;
+	unsigned long flags;
+	bool dma;
+	u32 val;
+
+	rcu_read_lock();
+	m = sp_i2cm_model_find((const volatile void __force *)addr, &dma);
+	if (!m) {
+		rcu_read_unlock();
+		return readl(addr);
+	}
+
+	spin_lock_irqsave(&m->lock, flags);
+	m->nr_reads++;
+	if (dma) {
+		val = ((u32 *)&m->dma)[sp_i2cm_model_reg(addr, &m->dma)];
+	} else {
+		reg = sp_i2cm_model_reg(addr, &m->regs);
+		if (reg >= SP_I2CM_REG(data00_03))
+			memcpy(&val, &m->fifo[(reg - SP_I2CM_REG(data00_03)) * 4], sizeof(val));
+		else
+			val = ((u32 *)&m->regs)[reg];
+	}
+	spin_unlock_irqrestore(&m->lock, flags);
+	rcu_read_unlock();
+
+	return val;
+}
+EXPORT_SYMBOL_GPL(sp_i2cm_model_readl);
+
+static void sp_i2cm_model_write_reg(struct sp_i2cm_model *m, unsigned int reg, u32 val)
+{
+	struct regs_i2cm_s *r = &m->regs;
+	unsigned int word;
+	bool ack = false;
+
+	switch (reg) {
+	case SP_I2CM_REG(control0):
+		r->control0 = val & ~I2C_CTL0_SW_RESET;
+		if (val & I2C_CTL0_SW_RESET)
+			sp_i2cm_model_reset(m);
+		break;
+
+	case SP_I2CM_REG(control1):
+		r->control1 = val;
+		r->interrupt &= ~sp_i2cm_model_ctl1_to_flags(val);
+		ack = true;
+		break;
+
+	case SP_I2CM_REG(control6):
+		r->control6 = val;
+		r->i2cm_status3 &= ~val;
+		ack = true;
+		break;
+
+	case SP_I2CM_REG(i2cm_mode):
+		r->i2cm_mode = val;
+		if ((val & I2C_MODE_MANUAL_TRIG) && m->phase == SP_MODEL_IDLE)
+			sp_i2cm_model_start(m);
+		break;
+
+	case SP_I2CM_REG(data00_03) ... SP_I2CM_REG(data28_31):
+		word = reg - SP_I2CM_REG(data00_03);
+		/* while a write runs, data00_03 feeds the FIFO */
+		if (m->phase != SP_MODEL_IDLE && !word) {
+			if (m->fifo_words == SP_I2CM_MODEL_FIFO_WORDS) {
+				r->interrupt |= I2C_INT_FULL_FLAG;
+				break;
+			}
+			word = m->fifo_push;
+			m->fifo_push = (m->fifo_push + 1) % SP_I2CM_MODEL_FIFO_WORDS;
+			m->fifo_words++;
+		}
+		memcpy(&m->fifo[word * 4], &val, sizeof(val));
+		break;
+
+	default:
+		((u32 *)r)[reg] = val;
+		break;
+	}
+
+	sp_i2cm_model_update_irq(m, ack);
+}
+
+static void sp_i2cm_model_write_dma_reg(struct sp_i2cm_model *m, unsigned int reg, u32 val)
+{
+	struct regs_i2cm_dma_s *d = &m->dma;
+	bool ack = false;
+
+	switch (reg) {
+	case SP_I2CM_DMA_REG(dma_config):
+		d->dma_config = val & ~I2C_DMA_CFG_DMA_GO;
+		/* in trigger mode the manual trigger starts the bus instead */
+		if ((val & I2C_DMA_CFG_DMA_GO) && m->phase == SP_MODEL_IDLE &&
+		    (m->regs.i2cm_mode & I2C_MODE_MANUAL_MODE))
+			sp_i2cm_model_start(m);
+		break;
+
+	case SP_I2CM_DMA_REG(int_flag):
+		d->int_flag &= ~val;
+		ack = true;
+		break;
+
+	default:
+		((u32 *)d)[reg] = val;
+		break;
+	}
+
+	sp_i2cm_model_update_irq(m, ack);
+}
+
+void sp_i2cm_model_writel(u32 val, volatile void __iomem *addr)
+{
+	struct sp_i2cm_model *m;
+	unsigned long flags;
+	bool dma;
+
+	rcu_read_lock();
+	m = sp_i2cm_model_find((volatile void __force *)addr, &dma);
+	if (!m) {
+		rcu_read_unlock();
+		writel(val, addr);
+		return;
+	}
+
+	spin_lock_irqsave(&m->lock, flags);
+	m->nr_writes++;
+	if (dma)
+		sp_i2cm_model_write_dma_reg(m, sp_i2cm_model_reg(addr, &m->dma), val);
+	else
+		sp_i2cm_model_write_reg(m, sp_i2cm_model_reg(addr, &m->regs), val);
+	spin_unlock_irqrestore(&m->lock, flags);
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL_GPL(sp_i2cm_model_writel);
+
+static void sp_i2cm_model_snapshot(struct sp_i2cm_model *m,
+				   struct sp_i2cm_model_counters *cnt, bool reset)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&m->lock, flags);
+	if (cnt) {
+		cnt->reads = m->nr_reads;
+		cnt->writes = m->nr_writes;
+		cnt->irqs = m->nr_irqs;
+		cnt->xfers = m->nr_xfers;
+		cnt->bytes = m->nr_bytes;
+	}
+	if (reset) {
+		m->nr_reads = 0;
+		m->nr_writes = 0;
+		m->nr_irqs = 0;
+		m->nr_xfers = 0;
+		m->nr_bytes = 0;
+	}
+	spin_unlock_irqrestore(&m->lock, flags);
+}
+
+/* The counters of the instance whose registers start at regs */
+int sp_i2cm_model_counters(const volatile void __iomem *regs,
+			   struct sp_i2cm_model_counters *cnt, bool reset)
+{
+	struct sp_i2cm_model *m;
+	int ret = -ENODEV;
+	bool dma;
+
+	rcu_read_lock();
+	m = sp_i2cm_model_find((const volatile void __force *)regs, &dma);
+	if (m && !dma) {
+		sp_i2cm_model_snapshot(m, cnt, reset);
+		ret = 0;
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sp_i2cm_model_counters);
+
+static int sp_i2cm_model_stats_show(struct seq_file *s, void *unused)
+{
+	struct sp_i2cm_model *m = s->private;
+	struct sp_i2cm_model_counters cnt;
+	u64 reads, writes, irqs, xfers, bytes;
+
+	sp_i2cm_model_snapshot(m, &cnt, false);
+	reads = cnt.reads;
+	writes = cnt.writes;
+	irqs = cnt.irqs;
+	xfers = cnt.xfers;
+	bytes = cnt.bytes;
+
+	seq_printf(s, "transfers:      %llu\n", xfers);
+	seq_printf(s, "bytes:          %llu\n", bytes);
+	seq_printf(s, "reg reads:      %llu\n", reads);
+	seq_printf(s, "reg writes:     %llu\n", writes);
+	seq_printf(s, "interrupts:     %llu\n", irqs);
+	if (bytes) {
+		/* in thousandths, the interesting values are well below one */
+		seq_printf(s, "mmio per byte:  %llu/1000\n", div64_u64((reads + writes) * 1000, bytes));
+		seq_printf(s, "irqs per byte:  %llu/1000\n", div64_u64(irqs * 1000, bytes));
+	}
+
+	return 0;
+}
+
+static int sp_i2cm_model_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sp_i2cm_model_stats_show, inode->i_private);
+}
+
+/* Any write starts a new measurement */
+static ssize_t sp_i2cm_model_stats_write(struct file *file, const char __user *buf,
+					 size_t count, loff_t *ppos)
+{
+	struct sp_i2cm_model *m = file_inode(file)->i_private;
+
+	sp_i2cm_model_snapshot(m, NULL, true);
+
+	return count;
+}
+
+static const struct file_operations sp_i2cm_model_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = sp_i2cm_model_stats_open,
+	.read = seq_read,
+	.write = sp_i2cm_model_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void sp_i2cm_model_destroy(struct sp_i2cm_model *m)
+{
+	if (m->irq > 0)
+		irq_dispose_mapping(m->irq);
+	if (!IS_ERR_OR_NULL(m->irq_domain))
+		irq_domain_remove_sim(m->irq_domain);
+	vfree(m->mem);
+	kfree(m);
+}
+
+static struct sp_i2cm_model *sp_i2cm_model_create(void)
+{
+	struct sp_i2cm_model *m;
+
+	m = kzalloc(sizeof(*m), GFP_KERNEL);
+	if (!m)
+		return ERR_PTR(-ENOMEM);
+
+	spin_lock_init(&m->lock);
+	hrtimer_init(&m->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	m->timer.function = sp_i2cm_model_tick;
+	m->regs.version = SP_I2CM_MODEL_VERSION;
+	m->dma.hw_version = SP_I2CM_MODEL_VERSION;
+
+	m->mem = vzalloc(SP_I2CM_MODEL_MEM_SIZE);
+	if (!m->mem)
+		goto err;
+
+	m->irq_domain = irq_domain_create_sim(NULL, 1);
+	if (IS_ERR(m->irq_domain))
+		goto err;
+
+	m->irq = irq_create_mapping(m->irq_domain, 0);
+	if (!m->irq)
+		goto err;
+
+	return m;
+
+err:
+	sp_i2cm_model_destroy(m);
+	return ERR_PTR(-ENOMEM);
+}
+
+static void sp_i2cm_model_remove_all(void)
+{
+	struct sp_i2cm_model *m;
+	int i;
+
+	debugfs_remove_recursive(sp_i2cm_model_debugfs);
+
+	for (i = 0; i < SP_I2CM_MODEL_MAX; i++) {
+		m = rcu_dereference_protected(sp_i2cm_models[i], 1);
+		if (!m)
+			continue;
+		if (m->pdev)
+			platform_device_unregister(m->pdev);
+		hrtimer_cancel(&m->timer);
+		RCU_INIT_POINTER(sp_i2cm_models[i], NULL);
+		// other adapters' accesses may still be looking at it
+		synchronize_rcu();
+		sp_i2cm_model_destroy(m);
+	}
+}
+
+static int __init sp_i2cm_model_init(void)
+{
+	struct platform_device_info info = {
+		.name = "sp7021-i2cm",
+		.num_res = 1,
+		.size_data = sizeof(struct sp_i2cm_model_pdata),
+		.dma_mask = DMA_BIT_MASK(32),
+	};
+	struct sp_i2cm_model_pdata pdata;
+	struct sp_i2cm_model *m;
+	int i, ret;
+
+	if (!instances || instances > SP_I2CM_MODEL_MAX)
+		return -EINVAL;
+
+	sp_i2cm_model_debugfs = debugfs_create_dir("sp_i2cm_model", NULL);
+
+	for (i = 0; i < instances; i++) {
+		struct resource res;
+		char name[16];
+
+		m = sp_i2cm_model_create();
+		if (IS_ERR(m)) {
+			ret = PTR_ERR(m);
+			goto err;
+		}
+		/* visible to the accessors before the driver can probe */
+		rcu_assign_pointer(sp_i2cm_models[i], m);
+
+		pdata.i2c_regs = (void __iomem __force *)&m->regs;
+		pdata.i2c_dma_regs = (void __iomem __force *)&m->dma;
+		memset(&res, 0, sizeof(res));
+		res.start = m->irq;
+		res.end = m->irq;
+		res.flags = IORESOURCE_IRQ;
+		info.id = first_nr + i;
+		info.res = &res;
+		info.data = &pdata;
+
+		m->pdev = platform_device_register_full(&info);
+		if (IS_ERR(m->pdev)) {
+			ret = PTR_ERR(m->pdev);
+			m->pdev = NULL;
+			goto err;
+		}
+
+		snprintf(name, sizeof(name), "i2cm%d", info.id);
+		debugfs_create_file(name, 0600, sp_i2cm_model_debugfs, m,
+				    &sp_i2cm_model_stats_fops);
+	}
+
+	return 0;
+
+err:
+	sp_i2cm_model_remove_all();
+	return ret;
+}
+module_init(sp_i2cm_model_init);
+
+static void __exit sp_i2cm_model_exit(void)
+{
+	sp_i2cm_model_remove_all();
+}
+module_exit(sp_i2cm_model_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Sunplus Technology");
+MODULE_DESCRIPTION("Sunplus I2C Master software model");
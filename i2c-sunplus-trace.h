@@ -0,0 +1,173 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2021 Sunplus Inc.
+ *
+ * Tracepoints of the SP7021 I2C master. One transfer emits xfer_begin when
+ * setup starts, trigger when the hardware is started, irq for every
+ * interrupt with the decoded flags, complete when the handler releases the
+ * waiter and wakeup when the waiter runs again, which splits its latency
+ * into setup, bus, interrupt and scheduling time.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM sp7021_i2c
+
+#if !defined(_I2C_SUNPLUS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _I2C_SUNPLUS_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#ifndef _I2C_SUNPLUS_TRACE_FLAGS
+#define _I2C_SUNPLUS_TRACE_FLAGS
+
+/* decoded interrupt flags, I2C_Irq_Flag_t_ then I2C_Irq_Dma_Flag_t_ */
+#define SP_I2C_TRACE_DONE            BIT(0)
+#define SP_I2C_TRACE_ADDR_NACK       BIT(1)
+#define SP_I2C_TRACE_DATA_NACK       BIT(2)
+#define SP_I2C_TRACE_EMPTY_THRESHOLD BIT(3)
+#define SP_I2C_TRACE_FIFO_EMPTY      BIT(4)
+#define SP_I2C_TRACE_FIFO_FULL       BIT(5)
+#define SP_I2C_TRACE_SCL_HOLD        BIT(6)
+#define SP_I2C_TRACE_RD_OVERFLOW     BIT(7)
+#define SP_I2C_TRACE_DMA_DONE        BIT(8)
+#define SP_I2C_TRACE_DMA_WCNT_ERR    BIT(9)
+#define SP_I2C_TRACE_DMA_WBEN_ERR    BIT(10)
+#define SP_I2C_TRACE_DMA_GDMA_TO     BIT(11)
+#define SP_I2C_TRACE_DMA_IP_TO       BIT(12)
+#define SP_I2C_TRACE_DMA_THRESHOLD   BIT(13)
+#define SP_I2C_TRACE_DMA_LENGTH0     BIT(14)
+
+#endif
+
+#define show_sp_i2c_state(state)				\
+	__print_symbolic(state,					\
+		{ 0, "write" },					\
+		{ 1, "read" },					\
+		{ 2, "idle" },					\
+		{ 3, "dma-write" },				\
+		{ 4, "dma-read" })
+
+#define show_sp_i2c_flags(flags)				\
+	__print_flags(flags, "|",				\
+		{ SP_I2C_TRACE_DONE, "done" },			\
+		{ SP_I2C_TRACE_ADDR_NACK, "addr-nack" },	\
+		{ SP_I2C_TRACE_DATA_NACK, "data-nack" },	\
+		{ SP_I2C_TRACE_EMPTY_THRESHOLD, "threshold" },	\
+		{ SP_I2C_TRACE_FIFO_EMPTY, "empty" },		\
+		{ SP_I2C_TRACE_FIFO_FULL, "full" },		\
+		{ SP_I2C_TRACE_SCL_HOLD, "scl-hold" },		\
+		{ SP_I2C_TRACE_RD_OVERFLOW, "overflow" },	\
+		{ SP_I2C_TRACE_DMA_DONE, "dma-done" },		\
+		{ SP_I2C_TRACE_DMA_WCNT_ERR, "dma-wcnt" },	\
+		{ SP_I2C_TRACE_DMA_WBEN_ERR, "dma-wben" },	\
+		{ SP_I2C_TRACE_DMA_GDMA_TO, "dma-gdma-timeout" }, \
+		{ SP_I2C_TRACE_DMA_IP_TO, "dma-ip-timeout" },	\
+		{ SP_I2C_TRACE_DMA_THRESHOLD, "dma-threshold" }, \
+		{ SP_I2C_TRACE_DMA_LENGTH0, "dma-length0" })
+
+DECLARE_EVENT_CLASS(sp7021_i2c_xfer,
+	TP_PROTO(int nr, u16 addr, int state, bool restart, u32 wr_len, u32 rd_len),
+	TP_ARGS(nr, addr, state, restart, wr_len, rd_len),
+
+	TP_STRUCT__entry(
+		__field(int, nr)
+		__field(u16, addr)
+		__field(int, state)
+		__field(bool, restart)
+		__field(u32, wr_len)
+		__field(u32, rd_len)
+	),
+
+	TP_fast_assign(
+		__entry->nr = nr;
+		__entry->addr = addr;
+		__entry->state = state;
+		__entry->restart = restart;
+		__entry->wr_len = wr_len;
+		__entry->rd_len = rd_len;
+	),
+
+	TP_printk("i2c-%d a=%03x %s%s wr=%u rd=%u",
+		  __entry->nr, __entry->addr, show_sp_i2c_state(__entry->state),
+		  __entry->restart ? "+restart" : "", __entry->wr_len, __entry->rd_len)
+);
+
+DEFINE_EVENT(sp7021_i2c_xfer, sp7021_i2c_xfer_begin,
+	TP_PROTO(int nr, u16 addr, int state, bool restart, u32 wr_len, u32 rd_len),
+	TP_ARGS(nr, addr, state, restart, wr_len, rd_len)
+);
+
+DEFINE_EVENT(sp7021_i2c_xfer, sp7021_i2c_trigger,
+	TP_PROTO(int nr, u16 addr, int state, bool restart, u32 wr_len, u32 rd_len),
+	TP_ARGS(nr, addr, state, restart, wr_len, rd_len)
+);
+
+TRACE_EVENT(sp7021_i2c_irq,
+	TP_PROTO(int nr, u16 addr, int state, u32 len, u32 index, u32 flags),
+	TP_ARGS(nr, addr, state, len, index, flags),
+
+	TP_STRUCT__entry(
+		__field(int, nr)
+		__field(u16, addr)
+		__field(int, state)
+		__field(u32, len)
+		__field(u32, index)
+		__field(u32, flags)
+	),
+
+	TP_fast_assign(
+		__entry->nr = nr;
+		__entry->addr = addr;
+		__entry->state = state;
+		__entry->len = len;
+		__entry->index = index;
+		__entry->flags = flags;
+	),
+
+	TP_printk("i2c-%d a=%03x %s %u/%u flags=%s",
+		  __entry->nr, __entry->addr, show_sp_i2c_state(__entry->state),
+		  __entry->index, __entry->len, show_sp_i2c_flags(__entry->flags))
+);
+
+DECLARE_EVENT_CLASS(sp7021_i2c_result,
+	TP_PROTO(int nr, u16 addr, int state, u32 len, int ret),
+	TP_ARGS(nr, addr, state, len, ret),
+
+	TP_STRUCT__entry(
+		__field(int, nr)
+		__field(u16, addr)
+		__field(int, state)
+		__field(u32, len)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->nr = nr;
+		__entry->addr = addr;
+		__entry->state = state;
+		__entry->len = len;
+		__entry->ret = ret;
+	),
+
+	TP_printk("i2c-%d a=%03x %s len=%u ret=%d",
+		  __entry->nr, __entry->addr, show_sp_i2c_state(__entry->state),
+		  __entry->len, __entry->ret)
+);
+
+DEFINE_EVENT(sp7021_i2c_result, sp7021_i2c_complete,
+	TP_PROTO(int nr, u16 addr, int state, u32 len, int ret),
+	TP_ARGS(nr, addr, state, len, ret)
+);
+
+DEFINE_EVENT(sp7021_i2c_result, sp7021_i2c_wakeup,
+	TP_PROTO(int nr, u16 addr, int state, u32 len, int ret),
+	TP_ARGS(nr, addr, state, len, ret)
+);
+
+#endif /* _I2C_SUNPLUS_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE i2c-sunplus-trace
+#include <trace/define_trace.h>
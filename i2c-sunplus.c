@@ -21,26 +21,39 @@
 #include <linux/of_device.h>
 #include <linux/dma-mapping.h>
 #include <linux/jiffies.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/gpio/consumer.h>
+#include <linux/pinctrl/consumer.h>
+#include <linux/kref.h>
+#include <linux/poll.h>
+#include <linux/sched/signal.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "i2c-sunplus.h"
+#include "i2c-bench.h"
+
+#define CREATE_TRACE_POINTS
+#include "i2c-sunplus-trace.h"
 
-#ifdef CONFIG_PM_RUNTIME_I2C
 #include <linux/pm_runtime.h>
-#endif
-
 
-//#define I2C_RETEST
 
 #define I2C_FUNC_DEBUG
 #define I2C_DBG_INFO
 #define I2C_DBG_ERR
 
+// FUNC_DEBUG and DBG_INFO sit in the transfer and interrupt paths: pr_debug
 #ifdef I2C_FUNC_DEBUG
-	#define FUNC_DEBUG()    pr_info("[I2C] Debug: %s(%d)\n", __func__, __LINE__)
+	#define FUNC_DEBUG()    pr_debug("[I2C] Debug: %s(%d)\n", __func__, __LINE__)
 #else
 	#define FUNC_DEBUG()
 #endif
 
 #ifdef I2C_DBG_INFO
-	#define DBG_INFO(fmt, args ...)    pr_info("[I2C] Info (%d):  "  fmt"\n", __LINE__, ## args)
+	#define DBG_INFO(fmt, args ...)    pr_debug("[I2C] Info (%d):  "  fmt"\n", __LINE__, ## args)
 #else
 	#define DBG_INFO(fmt, args ...)
 #endif
@@ -54,8 +67,16 @@
 #define I2C_FREQ             400
 #define I2C_SLEEP_TIMEOUT    200
 #define I2C_SCL_DELAY        1  //SCl dalay xT
+#define I2C_AUTOSUSPEND_MS   50 // idle time before the clock is gated
 
-#define I2C_CLK_SOURCE_FREQ         27000  // KHz(27MHz)
+#define I2C_TARGET_NUM       128  // 7-bit addresses with their own speed
+#define I2C_CAL_WINDOW       32   // transactions per calibration window
+#define I2C_CAL_ERR_MAX      2    // errors tolerated in a window
+#define I2C_CAL_HOLDOFF      4    // clean windows before stepping up
+#define I2C_CAL_HOLDOFF_MAX  256
+#define I2C_RETRY_BACKOFF_MAX_US  5000
+
+#define I2C_CLK_SOURCE_FREQ         27000  // KHz(27MHz), when the clock has no rate
 #define I2C_BUFFER_SIZE             1024   // Byte
 
 
@@ -71,145 +92,58 @@
 //burst write use
 #define I2C_EMPTY_THRESHOLD_VALUE    4
 
-//burst read use
+//burst read use, the default of each adapter's dBurstBytes
 #define I2C_IS_READ16BYTE
 
 #ifdef I2C_IS_READ16BYTE
 #define I2C_BURST_RDATA_BYTES        16
-#define I2C_BURST_RDATA_FLAG         0x80008000
 #else
 #define I2C_BURST_RDATA_BYTES        4
-#define I2C_BURST_RDATA_FLAG         0x88888888
 #endif
 
+#define I2C_BURST_RDATA_MAX          16
+#define I2C_BURST_RDATA_FLAG_4       0x88888888
+#define I2C_BURST_RDATA_FLAG_16      0x80008000
+#define I2C_BURST_RDATA_FLAG(bytes)  ((bytes) == 16 ? I2C_BURST_RDATA_FLAG_16 : I2C_BURST_RDATA_FLAG_4)
 #define I2C_BURST_RDATA_ALL_FLAG     0xFFFFFFFF
+#define I2C_FIFO_WORDS               8
+
+//polled transfers, used in atomic context and when the bus time is short
+#define I2C_POLL_DELAY_US            2
+#define I2C_POLL_MAX_US              100    // estimated bus time worth polling
+#define I2C_POLL_SPIN_US             (2 * I2C_POLL_MAX_US)  // then sleep, unless atomic
+#define I2C_POLL_SLEEP_US            20
+
+//async queue
+#define I2C_ASYNC_DEPTH              64     // requests in flight per open file
+#define I2C_ASYNC_BATCH              16     // transfers per bus lock hold
+#define I2C_ASYNC_MAX_LEN            4096   // Byte, per direction
+
+//statistics, bus time histogram buckets of [2^n, 2^(n+1)) us
+#define I2C_STATS_HIST_BUCKETS       16
+
 
 
-//control0
-#define I2C_CTL0_FREQ(x)                  (x<<24)  //bit[26:24]
-#define I2C_CTL0_PREFETCH                 (1<<18)  //Now as read mode need to set high, otherwise dont care
-#define I2C_CTL0_RESTART_EN               (1<<17)  //0:disable 1:enable
-#define I2C_CTL0_SUBADDR_EN               (1<<16)  //For restart mode need to set high
-#define I2C_CTL0_SW_RESET                 (1<<15)
-#define I2C_CTL0_SLAVE_ADDR(x)            (x<<1)   //bit[7:1]
-
-//control1
-#define I2C_CTL1_ALL_CLR                  (0x3FF)
-#define I2C_CTL1_EMPTY_CLR                (1<<9)
-#define I2C_CTL1_SCL_HOLD_TOO_LONG_CLR    (1<<8)
-#define I2C_CTL1_SCL_WAIT_CLR             (1<<7)
-#define I2C_CTL1_EMPTY_THRESHOLD_CLR      (1<<6)
-#define I2C_CTL1_DATA_NACK_CLR            (1<<5)
-#define I2C_CTL1_ADDRESS_NACK_CLR         (1<<4)
-#define I2C_CTL1_BUSY_CLR                 (1<<3)
-#define I2C_CTL1_CLKERR_CLR               (1<<2)
-#define I2C_CTL1_DONE_CLR                 (1<<1)
-#define I2C_CTL1_SIFBUSY_CLR              (1<<0)
-
-//control2
-#define I2C_CTL2_FREQ_CUSTOM(x)           (x<<0)   //bit[10:0]
-#define I2C_CTL2_SCL_DELAY(x)             (x<<24)  //bit[25:24]
-#define I2C_CTL2_SDA_HALF_ENABLE          (1<<31)
-
-//control7
-#define I2C_CTL7_RDCOUNT(x)               (x<<16)  //bit[31:16]
-#define I2C_CTL7_WRCOUNT(x)               (x<<0)   //bit[15:0]
-
-
-#define I2C_CTL0_FREQ_MASK                  (0x7)     // 3 bit
-#define I2C_CTL0_SLAVE_ADDR_MASK            (0x7F)    // 7 bit
-#define I2C_CTL2_FREQ_CUSTOM_MASK           (0x7FF)   // 11 bit
-#define I2C_CTL2_SCL_DELAY_MASK             (0x3)     // 2 bit
-#define I2C_CTL7_RW_COUNT_MASK              (0xFFFF)  // 16 bit
-#define I2C_EN0_CTL_EMPTY_THRESHOLD_MASK    (0x7)     // 3 bit
-#define I2C_SG_DMA_LLI_INDEX_MASK           (0x1F)    // 5 bit
-
-//interrupt enable1
-#define I2C_EN1_BURST_RDATA_INT           (0x80008000)  //must sync with GET_BYTES_EACHTIME
-
-//interrupt enable2
-#define I2C_EN2_BURST_RDATA_OVERFLOW_INT  (0xFFFFFFFF)
-
-//i2c master mode
-#define I2C_MODE_DMA_MODE                 (1<<2)
-#define I2C_MODE_MANUAL_MODE              (1<<1)  //0:trigger mode 1:auto mode
-#define I2C_MODE_MANUAL_TRIG              (1<<0)
-
-
-//dma config
-#define I2C_DMA_CFG_DMA_GO                (1<<8)
-#define I2C_DMA_CFG_NON_BUF_MODE          (1<<2)
-#define I2C_DMA_CFG_SAME_SLAVE            (1<<1)
-#define I2C_DMA_CFG_DMA_MODE              (1<<0)
-
-//dma interrupt flag
-#define I2C_DMA_INT_LENGTH0_FLAG          (1<<6)
-#define I2C_DMA_INT_THRESHOLD_FLAG        (1<<5)
-#define I2C_DMA_INT_IP_TIMEOUT_FLAG       (1<<4)
-#define I2C_DMA_INT_GDMA_TIMEOUT_FLAG     (1<<3)
-#define I2C_DMA_INT_WB_EN_ERROR_FLAG      (1<<2)
-#define I2C_DMA_INT_WCNT_ERROR_FLAG       (1<<1)
-#define I2C_DMA_INT_DMA_DONE_FLAG         (1<<0)
-
-//dma interrupt enable
-#define I2C_DMA_EN_LENGTH0_INT            (1<<6)
-#define I2C_DMA_EN_THRESHOLD_INT          (1<<5)
-#define I2C_DMA_EN_IP_TIMEOUT_INT         (1<<4)
-#define I2C_DMA_EN_GDMA_TIMEOUT_INT       (1<<3)
-#define I2C_DMA_EN_WB_EN_ERROR_INT        (1<<2)
-#define I2C_DMA_EN_WCNT_ERROR_INT         (1<<1)
-#define I2C_DMA_EN_DMA_DONE_INT           (1<<0)
-
-//interrupt
-#define I2C_INT_RINC_INDEX(x)             (x<<18)  //bit[20:18]
-#define I2C_INT_WINC_INDEX(x)             (x<<15)  //bit[17:15]
-#define I2C_INT_SCL_HOLD_TOO_LONG_FLAG    (1<<11)
-#define I2C_INT_WFIFO_ENABLE              (1<<10)
-#define I2C_INT_FULL_FLAG                 (1<<9)
-#define I2C_INT_EMPTY_FLAG                (1<<8)
-#define I2C_INT_SCL_WAIT_FLAG             (1<<7)
-#define I2C_INT_EMPTY_THRESHOLD_FLAG      (1<<6)
-#define I2C_INT_DATA_NACK_FLAG            (1<<5)
-#define I2C_INT_ADDRESS_NACK_FLAG         (1<<4)
-#define I2C_INT_BUSY_FLAG                 (1<<3)
-#define I2C_INT_CLKERR_FLAG               (1<<2)
-#define I2C_INT_DONE_FLAG                 (1<<1)
-#define I2C_INT_SIFBUSY_FLAG              (1<<0)
-
-
-//interrupt enable0
-#define I2C_EN0_SCL_HOLD_TOO_LONG_INT     (1<<13)
-#define I2C_EN0_NACK_INT                  (1<<12)
-#define I2C_EN0_CTL_EMPTY_THRESHOLD(x)    (x<<9)  //bit[11:9]
-#define I2C_EN0_EMPTY_INT                 (1<<8)
-#define I2C_EN0_SCL_WAIT_INT              (1<<7)
-#define I2C_EN0_EMPTY_THRESHOLD_INT       (1<<6)
-#define I2C_EN0_DATA_NACK_INT             (1<<5)
-#define I2C_EN0_ADDRESS_NACK_INT          (1<<4)
-#define I2C_EN0_BUSY_INT                  (1<<3)
-#define I2C_EN0_CLKERR_INT                (1<<2)
-#define I2C_EN0_DONE_INT                  (1<<1)
-#define I2C_EN0_SIFBUSY_INT               (1<<0)
-
-
-#define I2C_RESET(id, val)          ((1 << (16 + id)) | (val << id))
-#define I2C_CLKEN(id, val)          ((1 << (16 + id)) | (val << id))
-#define I2C_GCLKEN(id, val)         ((1 << (16 + id)) | (val << id))
 
 #if IS_ENABLED(CONFIG_I2C_SLAVE)
-#if 0
-u32 datarx_phys;
-u32 datatx_phys;
-void __iomem * datarx;
-void __iomem * datatx;
-
-#define BUFFER_SIZE 0x40
-#define RX_OFFSET 	0x80000
-#define TX_OFFSET 	(RX_OFFSET + BUFFER_SIZE)
-#endif
 /* subsysctl */
 #define SIFC  BIT(6)	/* slave intr flags clear */
 
+/* loopback self-test, i2cm0 talking to its own slave block */
+#define I2C_SELFTEST_ADDR       0x3a
+#define I2C_SELFTEST_BUF_SIZE   4096
+#define I2C_SELFTEST_MAX_LEN    256
+#define I2C_SELFTEST_MAX_ITER   100000
+#endif
+
+#ifdef CONFIG_I2C_SUNPLUS_MODEL
+/* burst read length sweep, on the software model only */
+#define I2C_SWEEP_ADDR          0x50
+#define I2C_SWEEP_MAX_LEN       0xFFFF
+#endif
+
+#if IS_ENABLED(CONFIG_I2C_SLAVE)
+
 #define I2CS_REG_NAME        "i2cs"
 /* control */
 //#define SEN			(1 << 0) /* slave enable  bits[0] */
@@ -243,66 +177,6 @@ struct regs_i2cs_s {
 };
 #endif
 
-struct regs_i2cm_s {
-	unsigned int control0;      /* 00 */
-	unsigned int control1;      /* 01 */
-	unsigned int control2;      /* 02 */
-	unsigned int control3;      /* 03 */
-	unsigned int control4;      /* 04 */
-	unsigned int control5;      /* 05 */
-	unsigned int i2cm_status0;  /* 06 */
-	unsigned int interrupt;     /* 07 */
-	unsigned int int_en0;       /* 08 */
-	unsigned int i2cm_mode;     /* 09 */
-	unsigned int i2cm_status1;  /* 10 */
-	unsigned int i2cm_status2;  /* 11 */
-	unsigned int control6;      /* 12 */
-	unsigned int int_en1;       /* 13 */
-	unsigned int i2cm_status3;  /* 14 */
-	unsigned int i2cm_status4;  /* 15 */
-	unsigned int int_en2;       /* 16 */
-	unsigned int control7;      /* 17 */
-	unsigned int control8;      /* 18 */
-	unsigned int control9;      /* 19 */
-	unsigned int reserved[3];   /* 20~22 */
-	unsigned int version;       /* 23 */
-	unsigned int data00_03;     /* 24 */
-	unsigned int data04_07;     /* 25 */
-	unsigned int data08_11;     /* 26 */
-	unsigned int data12_15;     /* 27 */
-	unsigned int data16_19;     /* 28 */
-	unsigned int data20_23;     /* 29 */
-	unsigned int data24_27;     /* 30 */
-	unsigned int data28_31;     /* 31 */
-};
-
-struct regs_i2cm_dma_s {
-	unsigned int hw_version;                /* 00 */
-	unsigned int dma_config;                /* 01 */
-	unsigned int dma_length;                /* 02 */
-	unsigned int dma_addr;                  /* 03 */
-	unsigned int port_mux;                  /* 04 */
-	unsigned int int_flag;                  /* 05 */
-	unsigned int int_en;                    /* 06 */
-	unsigned int sw_reset_state;            /* 07 */
-	unsigned int reserved[2];               /* 08~09 */
-	unsigned int sg_dma_index;              /* 10 */
-	unsigned int sg_dma_config;             /* 11 */
-	unsigned int sg_dma_length;             /* 12 */
-	unsigned int sg_dma_addr;               /* 13 */
-	unsigned int reserved2;                 /* 14 */
-	unsigned int sg_setting;                /* 15 */
-	unsigned int threshold;                 /* 16 */
-	unsigned int reserved3;                 /* 17 */
-	unsigned int gdma_read_timeout;         /* 18 */
-	unsigned int gdma_write_timeout;        /* 19 */
-	unsigned int ip_read_timeout;           /* 20 */
-	unsigned int ip_write_timeout;          /* 21 */
-	unsigned int write_cnt_debug;           /* 22 */
-	unsigned int w_byte_en_debug;           /* 23 */
-	unsigned int sw_reset_write_cnt_debug;  /* 24 */
-	unsigned int reserved4[7];              /* 25~31 */
-};
 
 enum I2C_Status_e_ {
 	I2C_SUCCESS,                /* successful */
@@ -326,56 +200,97 @@ enum I2C_State_e_ {
 	I2C_DMA_READ_STATE, /* i2c is dma read */
 };
 
-enum I2C_switch_e_ {
-	I2C_POWER_ALL_SWITCH,
-	I2C_POWER_NO_SWITCH,
+/*
+ * Bus timings, computed once at probe for the standard speeds and for the
+ * adapter's own bus frequency. A transfer only writes the control2 image.
+ */
+enum I2C_Speed_e_ {
+	I2C_SPEED_STANDARD,
+	I2C_SPEED_FAST,
+	I2C_SPEED_FAST_PLUS,
+	I2C_SPEED_BUS,
+	I2C_SPEED_NUM,
+};
+
+struct I2C_Timing_t_ {
+	unsigned int dBusFreq;  /* requested SCL, Hz */
+	unsigned int dFreq;     /* resulting SCL, KHz */
+	unsigned int dCtl2;     /* divider, SCL delay and SDA half */
+};
+
+/* Per target address speed limit and calibration state */
+struct I2C_Target_t_ {
+	struct I2C_Timing_t_ stTiming;  /* used by transfers to the target */
+	unsigned char bCeiling;         /* fastest allowed, enum I2C_Speed_e_ */
+	unsigned char bSpeed;           /* current table entry */
+	unsigned char bDelay;           /* current SCL delay */
+	unsigned char bSeen;            /* has acknowledged at least once */
+	unsigned char bProbing;         /* stepped up, no clean window yet */
+	unsigned short wWindow;
+	unsigned short wErrors;
+	unsigned int dClean;            /* clean windows in a row */
+	unsigned int dHoldOff;          /* clean windows needed to step up */
+	unsigned int dXfers;
+	unsigned int dErrors;
+	unsigned int dBackoffs;
+	unsigned int dAdvances;
 };
 
 struct I2C_Cmd_t_ {
 	unsigned int dDevId;
 	unsigned int dFreq;
+	const struct I2C_Timing_t_ *pstTiming;
 	unsigned int dSlaveAddr;
 	unsigned int dRestartEn;
 	unsigned int dWrDataCnt;
 	unsigned int dRdDataCnt;
 	unsigned char *pWrData;
 	unsigned char *pRdData;
+	unsigned char bFirst;   /* nothing of the transfer went out before */
 };
 
-struct I2C_Irq_Dma_Flag_t_ {
-	unsigned char bDmaDone;
-	unsigned char bWCntError;
-	unsigned char bWBEnError;
-	unsigned char bGDmaTimeout;
-	unsigned char bIPTimeout;
-	unsigned char bThreshold;
-	unsigned char bLength0;
-};
-
-struct I2C_Irq_Flag_t_ {
-	unsigned char bActiveDone;
-	unsigned char bAddrNack;
-	unsigned char bDataNack;
-	unsigned char bEmptyThreshold;
-	unsigned char bFiFoEmpty;
-	unsigned char bFiFoFull;
-	unsigned char bSCLHoldTooLong;
-	unsigned char bRdOverflow;
-};
+/* I2C_Irq_Event_t_.dFlags, decoded interrupt status in the trace layout */
+#define I2C_IRQ_DONE                 SP_I2C_TRACE_DONE
+#define I2C_IRQ_ADDR_NACK            SP_I2C_TRACE_ADDR_NACK
+#define I2C_IRQ_DATA_NACK            SP_I2C_TRACE_DATA_NACK
+#define I2C_IRQ_EMPTY_THRESHOLD      SP_I2C_TRACE_EMPTY_THRESHOLD
+#define I2C_IRQ_FIFO_EMPTY           SP_I2C_TRACE_FIFO_EMPTY
+#define I2C_IRQ_FIFO_FULL            SP_I2C_TRACE_FIFO_FULL
+#define I2C_IRQ_SCL_HOLD             SP_I2C_TRACE_SCL_HOLD
+#define I2C_IRQ_RD_OVERFLOW          SP_I2C_TRACE_RD_OVERFLOW
+#define I2C_IRQ_DMA_DONE             SP_I2C_TRACE_DMA_DONE
+#define I2C_IRQ_DMA_WCNT_ERR         SP_I2C_TRACE_DMA_WCNT_ERR
+#define I2C_IRQ_DMA_WBEN_ERR         SP_I2C_TRACE_DMA_WBEN_ERR
+#define I2C_IRQ_DMA_GDMA_TO          SP_I2C_TRACE_DMA_GDMA_TO
+#define I2C_IRQ_DMA_IP_TO            SP_I2C_TRACE_DMA_IP_TO
+#define I2C_IRQ_DMA_THRESHOLD        SP_I2C_TRACE_DMA_THRESHOLD
+#define I2C_IRQ_DMA_LENGTH0          SP_I2C_TRACE_DMA_LENGTH0
+#define I2C_IRQ_NACK                 (I2C_IRQ_ADDR_NACK | I2C_IRQ_DATA_NACK)
+#define I2C_IRQ_DMA_SHIFT            8      // DMA int_flag bits, in order
 
+/*
+ * The waiter sets up the first half before the trigger and the handler only
+ * reads it. The handler owns the second half until it completes the
+ * transfer, on its own cache line so its stores leave the setup alone.
+ */
 struct I2C_Irq_Event_t_ {
 	enum I2C_State_e_ eRWState;
-	struct I2C_Irq_Flag_t_ stIrqFlag;
-	struct I2C_Irq_Dma_Flag_t_ stIrqDmaFlag;
-	unsigned int dDevId;
-	unsigned int dBurstCount;
+	unsigned int dDataTotalLen;
 	unsigned int dBurstRemainder;
+	unsigned char *pDataBuf;
+	ktime_t tTrigger;
+	unsigned int dDmaIntEn;     /* int_en of the DMA engine */
+	unsigned int dBurstBytes;   /* burst read size, 4 or 16 */
+	unsigned char bPolled;
+	unsigned char bI2CBusy;
+
+	unsigned int dFlags ____cacheline_aligned;  /* I2C_IRQ_* */
+	unsigned int dIntEn;        /* int_en0, without the threshold */
+	unsigned int dBurstCount;
 	unsigned int dDataIndex;
-	unsigned int dDataTotalLen;
 	unsigned int dRegDataIndex;
-	unsigned char bI2CBusy;
 	unsigned char bRet;
-	unsigned char *pDataBuf;
+	unsigned char bComplete;    /* the waiter has been released */
 };
 
 
@@ -396,74 +311,157 @@ enum I2C_Active_Mode_e_ {
 };
 
 
-struct i2c_compatible {
-	int mode; /* clk source switch*/
+struct I2C_Stats_t_ {
+	atomic64_t transfers;
+	atomic64_t bytes;
+	atomic64_t pio;
+	atomic64_t dma;
+	atomic64_t restarts;
+	atomic64_t addr_nacks;
+	atomic64_t data_nacks;
+	atomic64_t scl_hold;
+	atomic64_t fifo_empty;
+	atomic64_t overflows;
+	atomic64_t timeouts;
+	atomic64_t resets;
+	atomic64_t retries;
+	atomic64_t recoveries;
+	atomic64_t pm_suspends;
+	atomic64_t pm_resumes;
+	atomic64_t pm_gated_us;       /* time spent with the clock gated */
+	atomic64_t pm_wake_ns;        /* transfers waiting for a resume, total */
+	atomic64_t pm_wake_max_ns;
+	atomic64_t bus_time[I2C_STATS_HIST_BUCKETS];
+};
+
+/* Outlives the controller while async files are open */
+struct sp_i2c_async {
+	struct kref ref;
+	spinlock_t lock;
+	struct list_head queue;
+	struct work_struct work;
+	struct i2c_adapter *adap;
+	bool dead;
+	struct miscdevice misc;
+	char name[I2C_NAME_SIZE + 8];
 };
 
 struct SpI2C_If_t_ {
-	struct i2c_msg *msgs;  /* messages currently handled */
-	struct i2c_adapter adap;
-	struct device *dev;
-	struct I2C_Cmd_t_ stCmdInfo;
+	/* per transfer, read by the handler */
 	struct I2C_Irq_Event_t_ stIrqEvent;
+	struct I2C_Cmd_t_ stCmdInfo ____cacheline_aligned;
 	void __iomem *i2c_regs;
+	void __iomem *i2c_dma_regs;
+	struct i2c_msg *msgs;  /* messages currently handled */
+	int irq;
+	bool atomic;   /* in master_xfer_atomic, no sleeping and no DMA */
 
+	/* written from both sides */
+	wait_queue_head_t wait ____cacheline_aligned;
+	struct I2C_Stats_t_ stStats;
+
+	struct i2c_adapter adap ____cacheline_aligned;
+	struct device *dev;
 	struct clk *clk;
 	struct reset_control *rstc;
+	struct i2c_bus_recovery_info stRecovery;
 	unsigned int i2c_clk_freq;
-	int irq;
-	wait_queue_head_t wait;
+	unsigned int dBurstBytes;  /* burst read size of PIO reads */
+	unsigned long src_clk_rate;
+	struct i2c_timings timings;
+	struct I2C_Timing_t_ stTiming[I2C_SPEED_NUM];
+	struct I2C_Target_t_ stTarget[I2C_TARGET_NUM];
 
-	void __iomem *i2c_dma_regs;
 	dma_addr_t dma_phy_base;
 	void *dma_vir_base;
-	unsigned int mode;
+	struct dentry *debugfs;
+	struct sp_i2c_async *async;
+	bool atomic_clk;  /* clock enabled by an atomic transfer while suspended */
+	ktime_t tSuspend;
 #if IS_ENABLED(CONFIG_I2C_SLAVE)
 	void __iomem *i2c_slave_regs;
 	int irq_slave;
 	struct i2c_client *slave;
+	struct sp_i2cs_selftest *selftest;
 	//enum sp_i2c_slave_state slave_state;
 #endif
+#ifdef CONFIG_I2C_SUNPLUS_MODEL
+	struct sp_i2cm_sweep *sweep;
+#endif
 };
 
+#if IS_ENABLED(CONFIG_I2C_SLAVE)
+struct sp_i2cs_selftest {
+	struct mutex lock;
+	struct i2c_client *client;  /* internal slave backend, during a run */
+	u8 mem[I2C_SELFTEST_BUF_SIZE];
+	unsigned int wr_idx;
+	unsigned int rd_idx;
+
+	/* last run */
+	unsigned int len;
+	unsigned int iterations;
+	unsigned int done;
+	unsigned int mismatches;
+	int status;
+	u64 elapsed_ns;
+	u64 min_ns, p50_ns, p99_ns, max_ns;
+};
+#endif
 
+#ifdef CONFIG_I2C_SUNPLUS_MODEL
+struct sp_i2cm_sweep_run {
+	unsigned int burst_bytes;
+	unsigned int lengths;       /* lengths read back */
+	unsigned int failures;      /* failed transfers and mismatches */
+	unsigned int first_bad;     /* length of the first failure */
+	unsigned int bad_offset;    /* first wrong byte of that length */
+	int status;
+	struct sp_i2cm_model_counters cnt;
+};
 
-#ifdef I2C_RETEST
-int test_count;
+struct sp_i2cm_sweep {
+	struct mutex lock;
+	unsigned int first, last, step;
+	struct sp_i2cm_sweep_run run[2];
+};
 #endif
 
+
+
+
 #if IS_ENABLED(CONFIG_I2C_SLAVE)
 #if 1
 static void sp_i2cs_enable_slave(struct regs_i2cs_s *sr)
 {
 	int val;
-	val = readl(&sr->control);
+	val = sp_readl(&sr->control);
 	val |= SEN;
-	writel(val, &sr->control);
+	sp_writel(val, &sr->control);
 }
 #endif
 
 static bool sp_i2cs_rw_mode(struct regs_i2cs_s *sr)
 {
-	return (readl(&sr->data[5]) & BIT(0));//iop_data[9]
+	return (sp_readl(&sr->data[5]) & BIT(0));//iop_data[9]
 }
 
 /* Whether the register iop_data has data when master write. 1:full 0:empty */
 static bool sp_i2cs_data_mw_full(struct regs_i2cs_s *sr)
 {
-	return (readl(&sr->data[7]) & BIT(2));//iop_data[9]
+	return (sp_readl(&sr->data[7]) & BIT(2));//iop_data[9]
 }
 
 /* Whether the iop internal buffer is full when master read. 1:full 0:empty */
 static bool sp_i2cs_data_fifo_full(struct regs_i2cs_s *sr)
 {
-	return (readl(&sr->data[6]) & BIT(3));//iop_data[9]
+	return (sp_readl(&sr->data[6]) & BIT(3));//iop_data[9]
 }
 
 /* Whether the register iop_data has data when master read. 1:full 0:empty */
 static bool sp_i2cs_data_mr_full(struct regs_i2cs_s *sr)
 {
-	return (readl(&sr->data[6]) & BIT(4));//iop_data[9]
+	return (sp_readl(&sr->data[6]) & BIT(4));//iop_data[9]
 }
 
 /* set the iopdata empty flag in master write case. 1:full 0:empty */
@@ -471,9 +469,9 @@ static void sp_i2cs_data_empty_set(struct regs_i2cs_s *sr)
 {
 	int val;
 
-	val = readl(&sr->data[7]);
+	val = sp_readl(&sr->data[7]);
 	val &= ~BIT(2);
-	writel(val, &sr->data[7]);
+	sp_writel(val, &sr->data[7]);
 }
 
 /* set the iopdata full flag in master read case. 1:full 0:empty */
@@ -481,9 +479,9 @@ static void sp_i2cs_data_full_set(struct regs_i2cs_s *sr)
 {
 	int val;
 
-	val = readl(&sr->data[6]);
+	val = sp_readl(&sr->data[6]);
 	val |= BIT(4);
-	writel(val, &sr->data[6]);
+	sp_writel(val, &sr->data[6]);
 }
 
 /* clear the iopdata full flag in master read case. 1:full 0:empty 
@@ -493,9 +491,9 @@ static void sp_i2cs_data_full_clear(struct regs_i2cs_s *sr)
 {
 	int val;
 
-	val = readl(&sr->data[6]);
+	val = sp_readl(&sr->data[6]);
 	val &= ~BIT(4);
-	writel(val, &sr->data[6]);
+	sp_writel(val, &sr->data[6]);
 }
 
 
@@ -504,74 +502,65 @@ static void sp_i2cs_clr_flag(struct regs_i2cs_s *sr)
 {
 	int val;
 
-	val = readl(&sr->subsysctl);
+	val = sp_readl(&sr->subsysctl);
 	val |= SIFC;
-	writel(val, &sr->subsysctl);
+	sp_writel(val, &sr->subsysctl);
 }
 
 static void sp_i2cs_addr_set(struct regs_i2cs_s *sr, unsigned short slave_addr)
 {
 	int val;
 
-	val = readl(&sr->control);
+	val = sp_readl(&sr->control);
 	val &= (~SADDR(SADDR_MASK));
 	val |= SADDR(slave_addr);
-	writel(val, &sr->control);
+	sp_writel(val, &sr->control);
 }
 
 static void sp_i2cs_data_set(struct regs_i2cs_s *sr, unsigned int val)
 {
 	u32 temp;
 
-	temp = readl(&sr->data[6]);
+	temp = sp_readl(&sr->data[6]);
 	temp &= ~(0xFF00);//clear the data bit
 	temp |= (val << 8);
-	writel(temp, &sr->data[6]);//iop_data[10] low bit
+	sp_writel(temp, &sr->data[6]);//iop_data[10] low bit
 }
 
 static unsigned int sp_i2cs_data_get(struct regs_i2cs_s *sr)
 {
-	return (readl(&sr->data[7]) >> 8);//iop_data[11] high bit
+	return (sp_readl(&sr->data[7]) >> 8);//iop_data[11] high bit
 	//readl(datarx + offset);
 }
 #endif
 
+/* control1 only holds the clear bits, pulse them without reading it back */
 void sp_i2cm_status_clear(struct regs_i2cm_s *sr, unsigned int flag)
 {
-	unsigned int ctl1;
-
-		ctl1 = readl(&sr->control1);
-		ctl1 |= flag;
-		writel(ctl1, &sr->control1);
-
-		ctl1 = readl(&sr->control1);
-		ctl1 &= (~flag);
-		writel(ctl1, &sr->control1);
+		sp_writel(flag & I2C_CTL1_ALL_CLR, &sr->control1);
+		sp_writel(0, &sr->control1);
 }
 
+/* write 1 to clear, flags raised since they were read stay pending */
 void sp_i2cm_dma_int_flag_clear(struct regs_i2cm_dma_s *sr_dma, unsigned int flag)
 {
-	unsigned int val;
-
-	val = readl(&sr_dma->int_flag);
-	val |= flag;
-	writel(val, &sr_dma->int_flag);
+		sp_writel(flag, &sr_dma->int_flag);
 }
 
 void sp_i2cm_reset(struct regs_i2cm_s *sr)
 {
 	unsigned int ctl0;
 
-	ctl0 = readl(&sr->control0);
+	ctl0 = sp_readl(&sr->control0);
 	ctl0 |= I2C_CTL0_SW_RESET;
-	writel(ctl0, &sr->control0);
+	sp_writel(ctl0, &sr->control0);
 
 	udelay(2);
 }
 
 void sp_i2cm_data0_set(struct regs_i2cm_s *sr, unsigned int *wdata)
 {
-	writel(*wdata, &sr->data00_03);
+	sp_writel(*wdata, &sr->data00_03);
 }
 
 
@@ -579,50 +568,50 @@ void sp_i2cm_int_en0_disable(struct regs_i2cm_s *sr, unsigned int int0)
 {
 	unsigned int val;
 
-	val = readl(&sr->int_en0);
+	val = sp_readl(&sr->int_en0);
 	val &= (~int0);
-	writel(val, &sr->int_en0);
+	sp_writel(val, &sr->int_en0);
 
 }
 
 void sp_i2cm_rdata_flag_get(struct regs_i2cm_s *sr, unsigned int *flag)
 {
-		*flag = readl(&sr->i2cm_status3);
+		*flag = sp_readl(&sr->i2cm_status3);
 }
 
 void sp_i2cm_data_get(struct regs_i2cm_s *sr, unsigned int index, unsigned int *rdata)
 {
 		switch (index) {
 		case 0:
-			*rdata = readl(&sr->data00_03);
+			*rdata = sp_readl(&sr->data00_03);
 			break;
 
 		case 1:
-			*rdata = readl(&sr->data04_07);
+			*rdata = sp_readl(&sr->data04_07);
 			break;
 
 		case 2:
-			*rdata = readl(&sr->data08_11);
+			*rdata = sp_readl(&sr->data08_11);
 			break;
 
 		case 3:
-			*rdata = readl(&sr->data12_15);
+			*rdata = sp_readl(&sr->data12_15);
 			break;
 
 		case 4:
-			*rdata = readl(&sr->data16_19);
+			*rdata = sp_readl(&sr->data16_19);
 			break;
 
 		case 5:
-			*rdata = readl(&sr->data20_23);
+			*rdata = sp_readl(&sr->data20_23);
 			break;
 
 		case 6:
-			*rdata = readl(&sr->data24_27);
+			*rdata = sp_readl(&sr->data24_27);
 			break;
 
 		case 7:
-			*rdata = readl(&sr->data28_31);
+			*rdata = sp_readl(&sr->data28_31);
 			break;
 
 		default:
@@ -632,32 +621,19 @@ void sp_i2cm_data_get(struct regs_i2cm_s *sr, unsigned int index, unsigned int *
 
 void sp_i2cm_rdata_flag_clear(struct regs_i2cm_s *sr, unsigned int flag)
 {
-		writel(flag, &sr->control6);
-		writel(0, &sr->control6);
+		sp_writel(flag, &sr->control6);
+		sp_writel(0, &sr->control6);
 }
 
-void sp_i2cm_clock_freq_set(struct regs_i2cm_s *sr,  unsigned int freq)
+void sp_i2cm_timing_set(struct regs_i2cm_s *sr, const struct I2C_Timing_t_ *timing)
 {
-	unsigned int div;
-	unsigned int ctl0, ctl2;
-
-		div = I2C_CLK_SOURCE_FREQ / freq;
-		div -= 1;
-		if (I2C_CLK_SOURCE_FREQ % freq != 0)
-			div += 1;
-
-		if (div > I2C_CTL2_FREQ_CUSTOM_MASK)
-			div = I2C_CTL2_FREQ_CUSTOM_MASK;
+	unsigned int ctl0;
 
-		ctl0 = readl(&sr->control0);
+		ctl0 = sp_readl(&sr->control0);
 		ctl0 &= (~I2C_CTL0_FREQ(I2C_CTL0_FREQ_MASK));
-		writel(ctl0, &sr->control0);
-
-		ctl2 = readl(&sr->control2);
-		ctl2 &= (~I2C_CTL2_FREQ_CUSTOM(I2C_CTL2_FREQ_CUSTOM_MASK));
-		ctl2 |= I2C_CTL2_FREQ_CUSTOM(div);
-		writel(ctl2, &sr->control2);
+		sp_writel(ctl0, &sr->control0);
 
+		sp_writel(timing->dCtl2, &sr->control2);
 }
 
 void sp_i2cm_slave_addr_set(struct regs_i2cm_s *sr, unsigned int addr)
@@ -665,21 +641,10 @@ void sp_i2cm_slave_addr_set(struct regs_i2cm_s *sr, unsigned int addr)
 	unsigned int t_addr = addr & I2C_CTL0_SLAVE_ADDR_MASK;
 	unsigned int ctl0;
 
-		ctl0 = readl(&sr->control0);
+		ctl0 = sp_readl(&sr->control0);
 		ctl0 &= (~I2C_CTL0_SLAVE_ADDR(I2C_CTL0_SLAVE_ADDR_MASK));
 		ctl0 |= I2C_CTL0_SLAVE_ADDR(t_addr);
-		writel(ctl0, &sr->control0);
-}
-
-void sp_i2cm_scl_delay_set(struct regs_i2cm_s *sr, unsigned int delay)
-{
-	unsigned int ctl2;
-
-		ctl2 = readl(&sr->control2);
-		ctl2 &= (~I2C_CTL2_SCL_DELAY(I2C_CTL2_SCL_DELAY_MASK));
-		ctl2 |= I2C_CTL2_SCL_DELAY(delay);
-		ctl2 &= (~(I2C_CTL2_SDA_HALF_ENABLE));
-		writel(ctl2, &sr->control2);
+		sp_writel(ctl0, &sr->control0);
 }
 
 void sp_i2cm_trans_cnt_set(struct regs_i2cm_s *sr, unsigned int write_cnt,
@@ -690,14 +655,14 @@ void sp_i2cm_trans_cnt_set(struct regs_i2cm_s *sr, unsigned int write_cnt,
 	unsigned int ctl7;
 
 		ctl7 = I2C_CTL7_WRCOUNT(t_write) | I2C_CTL7_RDCOUNT(t_read);
-		writel(ctl7, &sr->control7);
+		sp_writel(ctl7, &sr->control7);
 }
 
 void sp_i2cm_active_mode_set(struct regs_i2cm_s *sr, enum I2C_Active_Mode_e_ mode)
 {
 	unsigned int val;
 
-		val = readl(&sr->i2cm_mode);
+		val = sp_readl(&sr->i2cm_mode);
 		val &= (~(I2C_MODE_MANUAL_MODE | I2C_MODE_MANUAL_TRIG));
 		switch (mode) {
 		default:
@@ -708,26 +673,26 @@ void sp_i2cm_active_mode_set(struct regs_i2cm_s *sr, enum I2C_Active_Mode_e_ mod
 			val |= I2C_MODE_MANUAL_MODE;
 			break;
 		}
-		writel(val, &sr->i2cm_mode);
+		sp_writel(val, &sr->i2cm_mode);
 }
 
 void sp_i2cm_data_set(struct regs_i2cm_s *sr, unsigned int *wdata)
 {
-		writel(wdata[0], &sr->data00_03);
-		writel(wdata[1], &sr->data04_07);
-		writel(wdata[2], &sr->data08_11);
-		writel(wdata[3], &sr->data12_15);
-		writel(wdata[4], &sr->data16_19);
-		writel(wdata[5], &sr->data20_23);
-		writel(wdata[6], &sr->data24_27);
-		writel(wdata[7], &sr->data28_31);
+		sp_writel(wdata[0], &sr->data00_03);
+		sp_writel(wdata[1], &sr->data04_07);
+		sp_writel(wdata[2], &sr->data08_11);
+		sp_writel(wdata[3], &sr->data12_15);
+		sp_writel(wdata[4], &sr->data16_19);
+		sp_writel(wdata[5], &sr->data20_23);
+		sp_writel(wdata[6], &sr->data24_27);
+		sp_writel(wdata[7], &sr->data28_31);
 }
 
 void sp_i2cm_rw_mode_set(struct regs_i2cm_s *sr, enum I2C_RW_Mode_e_ rw_mode)
 {
 	unsigned int ctl0;
 
-		ctl0 = readl(&sr->control0);
+		ctl0 = sp_readl(&sr->control0);
 		switch (rw_mode) {
 		default:
 		case I2C_WRITE_MODE:
@@ -743,60 +708,34 @@ void sp_i2cm_rw_mode_set(struct regs_i2cm_s *sr, enum I2C_RW_Mode_e_ rw_mode)
 			ctl0 |= (I2C_CTL0_PREFETCH | I2C_CTL0_RESTART_EN | I2C_CTL0_SUBADDR_EN);
 			break;
 		}
-		writel(ctl0, &sr->control0);
+		sp_writel(ctl0, &sr->control0);
 }
 
 
 void sp_i2cm_int_en0_set(struct regs_i2cm_s *sr, unsigned int int0)
 {
-		writel(int0, &sr->int_en0);
+		sp_writel(int0, &sr->int_en0);
 		//printk("hal_i2cm_int_en0_set int_en0: 0x%x\n", readl(&(pI2cMReg[device_id]->int_en0)));
 }
 
 void sp_i2cm_int_en1_set(struct regs_i2cm_s *sr, unsigned int rdata_en)
 {
-		writel(rdata_en, &sr->int_en1);
+		sp_writel(rdata_en, &sr->int_en1);
 }
 
 void sp_i2cm_int_en2_set(struct regs_i2cm_s *sr, unsigned int overflow_en)
 {
-		writel(overflow_en, &sr->int_en2);
+		sp_writel(overflow_en, &sr->int_en2);
 }
 
 
-#define MOON0_BASE           0xF8000000
-
-struct Moon_RegBase_s {
-	void __iomem *moon0_regs;
-} Moon_RegBase;
-
-struct Moon_RegBase_s stMoonRegBase;
-
-struct regs_moon0_s {
-	unsigned int stamp;         /* 00 */
-	unsigned int clken[10];     /* 01~10 */
-	unsigned int gclken[10];    /* 11~20 */
-	unsigned int reset[10];     /* 21~30 */
-	unsigned int sfg_cfg_mode;  /* 31 */
-} regs_moon0;
-
-
-void sp_i2cm_enable(unsigned int device_id, void __iomem *membase)
-{
-	struct regs_moon0_s *pMoon0Reg = (struct regs_moon0_s *)membase;
-
-		writel(I2C_RESET(device_id, 0), &(pMoon0Reg->reset[3]));
-		writel(I2C_CLKEN(device_id, 1), &(pMoon0Reg->clken[3]));
-		writel(I2C_GCLKEN(device_id, 0), &(pMoon0Reg->gclken[3]));
-}
-
 void sp_i2cm_manual_trigger(struct regs_i2cm_s *sr)
 {
 	unsigned int val;
 
-		val = readl(&sr->i2cm_mode);
+		val = sp_readl(&sr->i2cm_mode);
 		val |= I2C_MODE_MANUAL_TRIG;
-		writel(val, &sr->i2cm_mode);
+		sp_writel(val, &sr->i2cm_mode);
 }
 
 void sp_i2cm_int_en0_with_thershold_set(struct regs_i2cm_s *sr, unsigned int int0, unsigned char threshold)
@@ -804,27 +743,27 @@ void sp_i2cm_int_en0_with_thershold_set(struct regs_i2cm_s *sr, unsigned int int
 	unsigned int val;
 
 		val = (int0 | I2C_EN0_CTL_EMPTY_THRESHOLD(threshold));
-		writel(val, &sr->int_en0);
+		sp_writel(val, &sr->int_en0);
 }
 
 void sp_i2cm_dma_mode_enable(struct regs_i2cm_s *sr)
 {
 	unsigned int val;
 
-		val = readl(&sr->i2cm_mode);
+		val = sp_readl(&sr->i2cm_mode);
 		val |= I2C_MODE_DMA_MODE;
-		writel(val, &sr->i2cm_mode);
+		sp_writel(val, &sr->i2cm_mode);
 }
 
 void sp_i2cm_dma_addr_set(struct regs_i2cm_dma_s *sr_dma, unsigned int addr)
 {
-		writel(addr, &sr_dma->dma_addr);
+		sp_writel(addr, &sr_dma->dma_addr);
 }
 
 void sp_i2cm_dma_length_set(struct regs_i2cm_dma_s *sr_dma, unsigned int length)
 {
 		length &= (0xFFFF);  //only support 16 bit
-		writel(length, &sr_dma->dma_length);
+		sp_writel(length, &sr_dma->dma_length);
 }
 
 void sp_i2cm_dma_rw_mode_set(struct regs_i2cm_dma_s *sr_dma,
@@ -832,7 +771,7 @@ void sp_i2cm_dma_rw_mode_set(struct regs_i2cm_dma_s *sr_dma,
 {
 	unsigned int val;
 
-		val = readl(&sr_dma->dma_config);
+		val = sp_readl(&sr_dma->dma_config);
 		switch (rw_mode) {
 		default:
 		case I2C_DMA_WRITE_MODE:
@@ -843,161 +782,345 @@ void sp_i2cm_dma_rw_mode_set(struct regs_i2cm_dma_s *sr_dma,
 			val &= (~I2C_DMA_CFG_DMA_MODE);
 			break;
 		}
-		writel(val, &sr_dma->dma_config);
+		sp_writel(val, &sr_dma->dma_config);
 
 }
 
 void sp_i2cm_dma_int_en_set(struct regs_i2cm_dma_s *sr_dma, unsigned int dma_int)
 {
-		writel(dma_int, &sr_dma->int_en);
+		sp_writel(dma_int, &sr_dma->int_en);
 }
 
 void sp_i2cm_dma_go_set(struct regs_i2cm_dma_s *sr_dma)
 {
 	unsigned int val;
 
-		val = readl(&sr_dma->dma_config);
+		val = sp_readl(&sr_dma->dma_config);
 		val |= I2C_DMA_CFG_DMA_GO;
-		writel(val, &sr_dma->dma_config);
+		sp_writel(val, &sr_dma->dma_config);
 }
 
 
-static void _sp_i2cm_intflag_check(struct SpI2C_If_t_ *pstSpI2CInfo,
+/*
+ * Interrupt status bits, the int_en0 bits that enable them, their control1
+ * clear bits and the flag they decode to. A bit without an enable is always
+ * reported, one without a flag is only acknowledged.
+ */
+struct I2C_Irq_Decode_t_ {
+	unsigned int dStatus;
+	unsigned int dEnable;
+	unsigned int dClear;
+	unsigned int dFlag;
+};
+
+static const struct I2C_Irq_Decode_t_ stIrqDecode[] = {
+	{ I2C_INT_DONE_FLAG, I2C_EN0_DONE_INT, I2C_CTL1_DONE_CLR, I2C_IRQ_DONE },
+	{ I2C_INT_ADDRESS_NACK_FLAG, I2C_EN0_ADDRESS_NACK_INT | I2C_EN0_NACK_INT,
+	  I2C_CTL1_ADDRESS_NACK_CLR, I2C_IRQ_ADDR_NACK },
+	{ I2C_INT_DATA_NACK_FLAG, I2C_EN0_DATA_NACK_INT | I2C_EN0_NACK_INT,
+	  I2C_CTL1_DATA_NACK_CLR, I2C_IRQ_DATA_NACK },
+	{ I2C_INT_EMPTY_THRESHOLD_FLAG, I2C_EN0_EMPTY_THRESHOLD_INT,	// write use
+	  I2C_CTL1_EMPTY_THRESHOLD_CLR, I2C_IRQ_EMPTY_THRESHOLD },
+	{ I2C_INT_EMPTY_FLAG, I2C_EN0_EMPTY_INT, I2C_CTL1_EMPTY_CLR, I2C_IRQ_FIFO_EMPTY },
+	{ I2C_INT_FULL_FLAG, 0, 0, I2C_IRQ_FIFO_FULL },	// write use (for debug)
+	{ I2C_INT_SCL_HOLD_TOO_LONG_FLAG, I2C_EN0_SCL_HOLD_TOO_LONG_INT,
+	  I2C_CTL1_SCL_HOLD_TOO_LONG_CLR, I2C_IRQ_SCL_HOLD },
+	{ I2C_INT_SCL_WAIT_FLAG, 0, I2C_CTL1_SCL_WAIT_CLR, 0 },
+	{ I2C_INT_BUSY_FLAG, 0, I2C_CTL1_BUSY_CLR, 0 },
+	{ I2C_INT_CLKERR_FLAG, 0, I2C_CTL1_CLKERR_CLR, 0 },
+	{ I2C_INT_SIFBUSY_FLAG, 0, I2C_CTL1_SIFBUSY_CLR, 0 },
+};
+
+/*
+ * Read each status register the current state can raise once, keep the
+ * enabled bits and acknowledge everything read with one control1 pulse and
+ * one DMA flag write.
+ */
+static void _sp_i2cm_irq_decode(struct SpI2C_If_t_ *pstSpI2CInfo,
 		struct I2C_Irq_Event_t_ *pstIrqEvent)
 {
-
 	struct regs_i2cm_s *sr = (struct regs_i2cm_s *)pstSpI2CInfo->i2c_regs;
-	unsigned int int_flag = 0;
-	unsigned int overflow_flag = 0;
-	#ifdef I2C_RETEST
-	unsigned int scl_belay = 0;
-    #endif
+	struct regs_i2cm_dma_s *sr_dma = (struct regs_i2cm_dma_s *)pstSpI2CInfo->i2c_dma_regs;
+	enum I2C_State_e_ eRWState = pstIrqEvent->eRWState;
+	const struct I2C_Irq_Decode_t_ *pstDecode;
+	unsigned int int_flag, dma_flag, overflow_flag;
+	unsigned int clear = 0;
+	unsigned int flags = 0;
+
+	int_flag = sp_readl(&sr->interrupt);
+	for (pstDecode = stIrqDecode; pstDecode < stIrqDecode + ARRAY_SIZE(stIrqDecode); pstDecode++) {
+		if (!(int_flag & pstDecode->dStatus))
+			continue;
+		clear |= pstDecode->dClear;
+		if (!pstDecode->dEnable || (pstIrqEvent->dIntEn & pstDecode->dEnable))
+			flags |= pstDecode->dFlag;
+	}
+	if (clear)
+		sp_i2cm_status_clear(sr, clear);
+
+	// read use, int_en2 is only set for burst reads
+	if (eRWState == I2C_READ_STATE) {
+		overflow_flag = sp_readl(&sr->i2cm_status4);
+		if (overflow_flag) {
+			DBG_ERR("I2C burst read data overflow !! overflow_flag = 0x%x\n", overflow_flag);
+			flags |= I2C_IRQ_RD_OVERFLOW;
+		}
+	}
 
+	// PIO transfers leave the DMA engine alone, a late DMA flag lands in idle
+	if ((eRWState != I2C_WRITE_STATE) && (eRWState != I2C_READ_STATE)) {
+		dma_flag = sp_readl(&sr_dma->int_flag);
+		if (dma_flag)
+			sp_i2cm_dma_int_flag_clear(sr_dma, dma_flag);
+		flags |= (dma_flag & pstIrqEvent->dDmaIntEn) << I2C_IRQ_DMA_SHIFT;
+	}
 
-	int_flag = readl(&sr->interrupt);
+	WRITE_ONCE(pstIrqEvent->dFlags, flags);
+}
 
-	if (int_flag & I2C_INT_DONE_FLAG) {
-		DBG_INFO("I2C is done !!\n");
-		pstIrqEvent->stIrqFlag.bActiveDone = 1;
-	} else {
-		pstIrqEvent->stIrqFlag.bActiveDone = 0;
-	}
+static u32 _sp_i2cm_trace_len(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct I2C_Irq_Event_t_ *pstIrqEvent = &(pstSpI2CInfo->stIrqEvent);
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
 
-	if (int_flag & I2C_INT_ADDRESS_NACK_FLAG) {
-		DBG_INFO("I2C slave address NACK !!\n");
-	#ifdef I2C_RETEST
+	if ((pstIrqEvent->eRWState == I2C_WRITE_STATE) || (pstIrqEvent->eRWState == I2C_DMA_WRITE_STATE))
+		return pstCmdInfo->dWrDataCnt;
+	return pstCmdInfo->dRdDataCnt;
+}
 
-		scl_belay = readl(&sr->control2);
-		scl_belay &= I2C_CTL2_SCL_DELAY(I2C_CTL2_SCL_DELAY_MASK);
+static void _sp_i2cm_trace_xfer(struct SpI2C_If_t_ *pstSpI2CInfo, bool trigger)
+{
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+	int state = pstSpI2CInfo->stIrqEvent.eRWState;
+	u32 wr_len = pstCmdInfo->dWrDataCnt;
+	u32 rd_len = pstCmdInfo->dRdDataCnt;
+
+	/* the command block keeps the other direction of the last message */
+	if ((state == I2C_WRITE_STATE) || (state == I2C_DMA_WRITE_STATE))
+		rd_len = 0;
+	else if (!pstCmdInfo->dRestartEn)
+		wr_len = 0;
+
+	if (trigger)
+		trace_sp7021_i2c_trigger(pstSpI2CInfo->adap.nr, pstCmdInfo->dSlaveAddr, state,
+					 pstCmdInfo->dRestartEn, wr_len, rd_len);
+	else
+		trace_sp7021_i2c_xfer_begin(pstSpI2CInfo->adap.nr, pstCmdInfo->dSlaveAddr, state,
+					    pstCmdInfo->dRestartEn, wr_len, rd_len);
+}
 
-		if (scl_belay == 0x00)
-			test_count++;
-		else if (test_count > 9)
-			test_count = 1;
-	#endif
-		pstIrqEvent->stIrqFlag.bAddrNack = 1;
-	} else {
-		pstIrqEvent->stIrqFlag.bAddrNack = 0;
-	}
+static void _sp_i2cm_trace_wakeup(struct SpI2C_If_t_ *pstSpI2CInfo, int ret)
+{
+	trace_sp7021_i2c_wakeup(pstSpI2CInfo->adap.nr, pstSpI2CInfo->stCmdInfo.dSlaveAddr,
+				pstSpI2CInfo->stIrqEvent.eRWState, _sp_i2cm_trace_len(pstSpI2CInfo), ret);
+}
 
-	if (int_flag & I2C_INT_DATA_NACK_FLAG) {
-		DBG_INFO("I2C slave data NACK !!\n");
-		pstIrqEvent->stIrqFlag.bDataNack = 1;
-	} else {
-		pstIrqEvent->stIrqFlag.bDataNack = 0;
-	}
+static unsigned int _sp_i2cm_timing_delay(const struct I2C_Timing_t_ *pstTiming)
+{
+	return (pstTiming->dCtl2 >> 24) & I2C_CTL2_SCL_DELAY_MASK;
+}
 
-	// write use
-	if (int_flag & I2C_INT_EMPTY_THRESHOLD_FLAG) {
-		DBG_INFO("I2C empty threshold occur !!\n");
-		pstIrqEvent->stIrqFlag.bEmptyThreshold = 1;
-	} else {
-		pstIrqEvent->stIrqFlag.bEmptyThreshold = 0;
+/* the next faster entry up to max_freq, or the next slower one */
+static enum I2C_Speed_e_ _sp_i2cm_speed_next(struct SpI2C_If_t_ *pstSpI2CInfo,
+					      unsigned int cur_freq, unsigned int max_freq,
+					      bool faster)
+{
+	struct I2C_Timing_t_ *pstTiming = pstSpI2CInfo->stTiming;
+	enum I2C_Speed_e_ next = I2C_SPEED_NUM;
+	unsigned int freq;
+	int i;
+
+	for (i = 0; i < I2C_SPEED_NUM; i++) {
+		freq = pstTiming[i].dBusFreq;
+		if (faster ? (freq <= cur_freq || freq > max_freq) : (freq >= cur_freq))
+			continue;
+		if (next == I2C_SPEED_NUM ||
+		    (faster ? (freq < pstTiming[next].dBusFreq) : (freq > pstTiming[next].dBusFreq)))
+			next = i;
 	}
 
-	// write use
-	if (int_flag & I2C_INT_EMPTY_FLAG) {
-		DBG_INFO("I2C FIFO empty occur !!\n");
-		pstIrqEvent->stIrqFlag.bFiFoEmpty = 1;
-	} else {
-		pstIrqEvent->stIrqFlag.bFiFoEmpty = 0;
-	}
+	return next;
+}
 
-	// write use (for debug)
-	if (int_flag & I2C_INT_FULL_FLAG) {
-		DBG_INFO("I2C FIFO full occur !!\n");
-		pstIrqEvent->stIrqFlag.bFiFoFull = 1;
-	} else {
-		pstIrqEvent->stIrqFlag.bFiFoFull = 0;
-	}
+static void _sp_i2cm_target_apply(struct SpI2C_If_t_ *pstSpI2CInfo,
+				  struct I2C_Target_t_ *pstTarget)
+{
+	pstTarget->stTiming = pstSpI2CInfo->stTiming[pstTarget->bSpeed];
+	pstTarget->stTiming.dCtl2 &= ~I2C_CTL2_SCL_DELAY(I2C_CTL2_SCL_DELAY_MASK);
+	pstTarget->stTiming.dCtl2 |= I2C_CTL2_SCL_DELAY(pstTarget->bDelay);
+}
 
-	if (int_flag & I2C_INT_SCL_HOLD_TOO_LONG_FLAG) {
-		DBG_INFO("I2C SCL hold too long occur !!\n");
-		pstIrqEvent->stIrqFlag.bSCLHoldTooLong = 1;
-	} else {
-		pstIrqEvent->stIrqFlag.bSCLHoldTooLong = 0;
-	}
-	sp_i2cm_status_clear(sr, I2C_CTL1_ALL_CLR);
+static void _sp_i2cm_target_reset(struct SpI2C_If_t_ *pstSpI2CInfo,
+				  struct I2C_Target_t_ *pstTarget, enum I2C_Speed_e_ ceiling)
+{
+	memset(pstTarget, 0, sizeof(*pstTarget));
+	pstTarget->bCeiling = ceiling;
+	pstTarget->bSpeed = ceiling;
+	pstTarget->bDelay = _sp_i2cm_timing_delay(&pstSpI2CInfo->stTiming[ceiling]);
+	pstTarget->dHoldOff = I2C_CAL_HOLDOFF;
+	_sp_i2cm_target_apply(pstSpI2CInfo, pstTarget);
+}
 
-	// read use
-	overflow_flag = readl(&sr->i2cm_status4);
+/* One step to more margin: more SCL delay, then the next lower speed */
+static bool _sp_i2cm_target_slower(struct SpI2C_If_t_ *pstSpI2CInfo,
+				   struct I2C_Target_t_ *pstTarget)
+{
+	enum I2C_Speed_e_ next;
 
-	if (overflow_flag) {
-		DBG_ERR("I2C burst read data overflow !! overflow_flag = 0x%x\n", overflow_flag);
-		pstIrqEvent->stIrqFlag.bRdOverflow = 1;
+	if (pstTarget->bDelay < I2C_CTL2_SCL_DELAY_MASK) {
+		pstTarget->bDelay++;
 	} else {
-		pstIrqEvent->stIrqFlag.bRdOverflow = 0;
+		next = _sp_i2cm_speed_next(pstSpI2CInfo,
+					   pstSpI2CInfo->stTiming[pstTarget->bSpeed].dBusFreq, 0, false);
+		if (next == I2C_SPEED_NUM)
+			return false;
+		pstTarget->bSpeed = next;
+		pstTarget->bDelay = _sp_i2cm_timing_delay(&pstSpI2CInfo->stTiming[next]);
 	}
+
+	_sp_i2cm_target_apply(pstSpI2CInfo, pstTarget);
+	return true;
 }
 
-static void _sp_i2cm_dma_intflag_check(struct SpI2C_If_t_ *pstSpI2CInfo,
-		struct I2C_Irq_Event_t_ *pstIrqEvent)
+/* The reverse step, never above the ceiling of the target */
+static bool _sp_i2cm_target_faster(struct SpI2C_If_t_ *pstSpI2CInfo,
+				   struct I2C_Target_t_ *pstTarget)
 {
-	struct regs_i2cm_dma_s *sr_dma = (struct regs_i2cm_dma_s *)pstSpI2CInfo->i2c_dma_regs;
-	unsigned int int_flag = 0;
-
-	int_flag = readl(&sr_dma->int_flag);
+	struct I2C_Timing_t_ *pstTiming = pstSpI2CInfo->stTiming;
+	enum I2C_Speed_e_ next;
 
-	if (int_flag & I2C_DMA_INT_DMA_DONE_FLAG) {
-		DBG_INFO("I2C DMA is done !!\n");
-		pstIrqEvent->stIrqDmaFlag.bDmaDone = 1;
+	if (pstTarget->bDelay > _sp_i2cm_timing_delay(&pstTiming[pstTarget->bSpeed])) {
+		pstTarget->bDelay--;
 	} else {
-		pstIrqEvent->stIrqDmaFlag.bDmaDone = 0;
+		next = _sp_i2cm_speed_next(pstSpI2CInfo, pstTiming[pstTarget->bSpeed].dBusFreq,
+					   pstTiming[pstTarget->bCeiling].dBusFreq, true);
+		if (next == I2C_SPEED_NUM)
+			return false;
+		pstTarget->bSpeed = next;
+		pstTarget->bDelay = I2C_CTL2_SCL_DELAY_MASK;
 	}
 
-	if (int_flag & I2C_DMA_INT_WCNT_ERROR_FLAG) {
-		DBG_INFO("I2C DMA WCNT ERR !!\n");
-		pstIrqEvent->stIrqDmaFlag.bWCntError = 1;
-	} else {
-		pstIrqEvent->stIrqDmaFlag.bWCntError = 0;
-	}
-	if (int_flag & I2C_DMA_INT_WB_EN_ERROR_FLAG) {
-		DBG_INFO("I2C DMA WB EN ERR !!\n");
-		pstIrqEvent->stIrqDmaFlag.bWBEnError = 1;
-	} else {
-		pstIrqEvent->stIrqDmaFlag.bWBEnError = 0;
-	}
-	if (int_flag & I2C_DMA_INT_GDMA_TIMEOUT_FLAG) {
-		DBG_INFO("I2C DMA timeout !!\n");
-		pstIrqEvent->stIrqDmaFlag.bGDmaTimeout = 1;
-	} else {
-		pstIrqEvent->stIrqDmaFlag.bGDmaTimeout = 0;
-	}
-	if (int_flag & I2C_DMA_INT_IP_TIMEOUT_FLAG) {
-		DBG_INFO("I2C IP timeout !!\n");
-		pstIrqEvent->stIrqDmaFlag.bIPTimeout = 1;
-	} else {
-		pstIrqEvent->stIrqDmaFlag.bIPTimeout = 0;
+	_sp_i2cm_target_apply(pstSpI2CInfo, pstTarget);
+	return true;
+}
+
+/*
+ * Adaptive timing. A target that has acknowledged before and then holds SCL
+ * too long is taken to be marginal at its timing. NACKs are not counted: a
+ * busy EEPROM NACKs its address until the write cycle is over and at24 polls
+ * it that way, which says nothing about the timing. More than
+ * I2C_CAL_ERR_MAX errors in a window moves it one step slower, a run
+ * of clean windows one step faster again. A step up that fails before its
+ * first clean window doubles the run needed for the next try, so the target
+ * settles on the fastest timing it passes instead of hunting around it.
+ */
+static void _sp_i2cm_calib_xfer(struct SpI2C_If_t_ *pstSpI2CInfo, int ret)
+{
+	unsigned int addr = pstSpI2CInfo->stCmdInfo.dSlaveAddr;
+	struct I2C_Target_t_ *pstTarget;
+	bool error;
+
+	if (addr >= I2C_TARGET_NUM)
+		return;
+	pstTarget = &pstSpI2CInfo->stTarget[addr];
+
+	// absent targets, a bus scan for instance, say nothing about the timing
+	if (ret == I2C_SUCCESS)
+		pstTarget->bSeen = 1;
+	else if (!pstTarget->bSeen)
+		return;
+
+	error = (ret == I2C_ERR_SCL_HOLD_TOO_LONG);
+
+	pstTarget->dXfers++;
+	pstTarget->wWindow++;
+	if (error) {
+		pstTarget->dErrors++;
+		pstTarget->wErrors++;
 	}
-	if (int_flag & I2C_DMA_INT_LENGTH0_FLAG) {
-		DBG_INFO("I2C Length is zero !!\n");
-		pstIrqEvent->stIrqDmaFlag.bLength0 = 1;
+
+	if (pstTarget->wErrors > I2C_CAL_ERR_MAX) {
+		if (pstTarget->bProbing)
+			pstTarget->dHoldOff = min_t(unsigned int, pstTarget->dHoldOff * 2,
+						    I2C_CAL_HOLDOFF_MAX);
+		if (_sp_i2cm_target_slower(pstSpI2CInfo, pstTarget))
+			pstTarget->dBackoffs++;
+		pstTarget->bProbing = 0;
+		pstTarget->dClean = 0;
+	} else if (pstTarget->wWindow < I2C_CAL_WINDOW) {
+		return;
+	} else if (pstTarget->wErrors) {
+		pstTarget->dClean = 0;
 	} else {
-		pstIrqEvent->stIrqDmaFlag.bLength0 = 0;
+		pstTarget->bProbing = 0;
+		if ((++pstTarget->dClean >= pstTarget->dHoldOff) &&
+		    _sp_i2cm_target_faster(pstSpI2CInfo, pstTarget)) {
+			pstTarget->dAdvances++;
+			pstTarget->bProbing = 1;
+			pstTarget->dClean = 0;
+		}
 	}
 
-	sp_i2cm_dma_int_flag_clear(sr_dma, 0x7F);  //write 1 to clear
+	pstTarget->wWindow = 0;
+	pstTarget->wErrors = 0;
+}
+
+/* Claim the event block, resetting only the handler's half */
+static void _sp_i2cm_event_begin(struct I2C_Irq_Event_t_ *pstIrqEvent)
+{
+	pstIrqEvent->bI2CBusy = 1;
+	pstIrqEvent->dFlags = 0;
+	pstIrqEvent->dBurstCount = 0;
+	pstIrqEvent->dDataIndex = 0;
+	pstIrqEvent->dRegDataIndex = 0;
+	pstIrqEvent->bRet = I2C_SUCCESS;
+	pstIrqEvent->bComplete = 0;
+}
+
+/*
+ * The handler is done with the transfer, release the waiter. Only the first
+ * result counts, a DMA transfer that failed on the bus must not be turned
+ * into a success by the DMA engine finishing afterwards.
+ */
+static void _sp_i2cm_complete(struct SpI2C_If_t_ *pstSpI2CInfo, int ret)
+{
+	struct I2C_Irq_Event_t_ *pstIrqEvent = &(pstSpI2CInfo->stIrqEvent);
+	struct I2C_Stats_t_ *pstStats = &(pstSpI2CInfo->stStats);
+	u64 us;
+
+	if (pstIrqEvent->bComplete)
+		return;
+	pstIrqEvent->bRet = ret;
+
+	us = ktime_us_delta(ktime_get(), pstIrqEvent->tTrigger);
+	atomic64_inc(&pstStats->bus_time[min_t(unsigned int, us ? ilog2(us) : 0,
+					       I2C_STATS_HIST_BUCKETS - 1)]);
+
+	// every error completion is followed by a controller reset, per attempt
+	if (pstIrqEvent->bRet != I2C_SUCCESS)
+		atomic64_inc(&pstStats->resets);
+
+	trace_sp7021_i2c_complete(pstSpI2CInfo->adap.nr, pstSpI2CInfo->stCmdInfo.dSlaveAddr,
+				  pstSpI2CInfo->stIrqEvent.eRWState, _sp_i2cm_trace_len(pstSpI2CInfo),
+				  pstSpI2CInfo->stIrqEvent.bRet);
+	WRITE_ONCE(pstIrqEvent->bComplete, 1);
+	wake_up(&pstSpI2CInfo->wait);
+}
+
+/*
+ * A bus error. The controller is stopped before the waiter is released,
+ * which may reprogram it for a retry straight away. A transfer that is
+ * already complete belongs to the waiter and is left alone.
+ */
+static void _sp_i2cm_fail(struct SpI2C_If_t_ *pstSpI2CInfo, int ret)
+{
+	struct regs_i2cm_s *sr = (struct regs_i2cm_s *)pstSpI2CInfo->i2c_regs;
+
+	if (READ_ONCE(pstSpI2CInfo->stIrqEvent.bComplete))
+		return;
 
+	sp_i2cm_reset(sr);
+	_sp_i2cm_complete(pstSpI2CInfo, ret);
 }
 
 static irqreturn_t _sp_i2cm_irqevent_handler(int irq, void *args)
@@ -1006,46 +1129,40 @@ static irqreturn_t _sp_i2cm_irqevent_handler(int irq, void *args)
 	struct I2C_Irq_Event_t_ *pstIrqEvent = &(pstSpI2CInfo->stIrqEvent);
 	struct regs_i2cm_s *sr = (struct regs_i2cm_s *)pstSpI2CInfo->i2c_regs;
 	unsigned char w_data[32] = {0};
-	unsigned char r_data[I2C_BURST_RDATA_BYTES] = {0};
+	unsigned char r_data[I2C_BURST_RDATA_MAX] = {0};
+	unsigned int burst_bytes = pstIrqEvent->dBurstBytes;
 	unsigned int rdata_flag = 0;
 	unsigned int bit_index = 0;
 	int i = 0, j = 0, k = 0;
 
-	_sp_i2cm_intflag_check(pstSpI2CInfo, pstIrqEvent);
+	_sp_i2cm_irq_decode(pstSpI2CInfo, pstIrqEvent);
 
 switch (pstIrqEvent->eRWState) {
 case I2C_WRITE_STATE:
 case I2C_DMA_WRITE_STATE:
-	if (pstIrqEvent->stIrqFlag.bActiveDone) {
-		DBG_INFO("I2C write success !!\n");
-		pstIrqEvent->bRet = I2C_SUCCESS;
-		wake_up(&pstSpI2CInfo->wait);
-	} else if (pstIrqEvent->stIrqFlag.bAddrNack || pstIrqEvent->stIrqFlag.bDataNack) {
+	if (pstIrqEvent->dFlags & I2C_IRQ_DONE) {
+		// a DMA write is complete when the engine says so, below
+		if (pstIrqEvent->eRWState == I2C_WRITE_STATE) {
+			DBG_INFO("I2C write success !!\n");
+			_sp_i2cm_complete(pstSpI2CInfo, I2C_SUCCESS);
+		}
+	} else if (pstIrqEvent->dFlags & I2C_IRQ_NACK) {
 
 		if (pstIrqEvent->eRWState == I2C_DMA_WRITE_STATE)
 			DBG_ERR("DMA wtire NACK!!\n");
 		else
 			DBG_ERR("wtire NACK!!\n");
 
-		pstIrqEvent->bRet = I2C_ERR_RECEIVE_NACK;
-		pstIrqEvent->stIrqFlag.bActiveDone = 1;
-		wake_up(&pstSpI2CInfo->wait);
-		sp_i2cm_reset(sr);
-	} else if (pstIrqEvent->stIrqFlag.bSCLHoldTooLong) {
+		_sp_i2cm_fail(pstSpI2CInfo, I2C_ERR_RECEIVE_NACK);
+	} else if (pstIrqEvent->dFlags & I2C_IRQ_SCL_HOLD) {
 		DBG_ERR("I2C SCL hold too long !!\n");
-		pstIrqEvent->bRet = I2C_ERR_SCL_HOLD_TOO_LONG;
-		pstIrqEvent->stIrqFlag.bActiveDone = 1;
-		wake_up(&pstSpI2CInfo->wait);
-		sp_i2cm_reset(sr);
-	} else if (pstIrqEvent->stIrqFlag.bFiFoEmpty) {
+		_sp_i2cm_fail(pstSpI2CInfo, I2C_ERR_SCL_HOLD_TOO_LONG);
+	} else if (pstIrqEvent->dFlags & I2C_IRQ_FIFO_EMPTY) {
 		DBG_ERR("I2C FIFO empty !!\n");
-		pstIrqEvent->bRet = I2C_ERR_FIFO_EMPTY;
-		pstIrqEvent->stIrqFlag.bActiveDone = 1;
-		wake_up(&pstSpI2CInfo->wait);
-		sp_i2cm_reset(sr);
+		_sp_i2cm_fail(pstSpI2CInfo, I2C_ERR_FIFO_EMPTY);
 	} else if ((pstIrqEvent->dBurstCount > 0) &&
 			(pstIrqEvent->eRWState == I2C_WRITE_STATE)) {
-		if (pstIrqEvent->stIrqFlag.bEmptyThreshold) {
+		if (pstIrqEvent->dFlags & I2C_IRQ_EMPTY_THRESHOLD) {
 			for (i = 0; i < I2C_EMPTY_THRESHOLD_VALUE; i++) {
 				for (j = 0; j < 4; j++) {
 
@@ -1060,6 +1177,7 @@ case I2C_DMA_WRITE_STATE:
 					    pstIrqEvent->dBurstCount--;
 					if (pstIrqEvent->dBurstCount == 0) {
 						sp_i2cm_int_en0_disable(sr, (I2C_EN0_EMPTY_THRESHOLD_INT | I2C_EN0_EMPTY_INT));
+						pstIrqEvent->dIntEn &= ~(I2C_EN0_EMPTY_THRESHOLD_INT | I2C_EN0_EMPTY_INT);
 						break;
 					}
 				}
@@ -1070,59 +1188,47 @@ case I2C_DMA_WRITE_STATE:
 
 case I2C_READ_STATE:
 case I2C_DMA_READ_STATE:
-		if (pstIrqEvent->stIrqFlag.bAddrNack || pstIrqEvent->stIrqFlag.bDataNack) {
+		if (pstIrqEvent->dFlags & I2C_IRQ_NACK) {
 
 			if (pstIrqEvent->eRWState == I2C_DMA_READ_STATE)
 				DBG_ERR("DMA read NACK!!\n");
 			else
 				DBG_ERR("read NACK!!\n");
 
-			pstIrqEvent->bRet = I2C_ERR_RECEIVE_NACK;
-			pstIrqEvent->stIrqFlag.bActiveDone = 1;
-			wake_up(&pstSpI2CInfo->wait);
-			sp_i2cm_reset(sr);
-		} else if (pstIrqEvent->stIrqFlag.bSCLHoldTooLong) {
+			_sp_i2cm_fail(pstSpI2CInfo, I2C_ERR_RECEIVE_NACK);
+		} else if (pstIrqEvent->dFlags & I2C_IRQ_SCL_HOLD) {
 			DBG_ERR("I2C SCL hold too long !!\n");
-			pstIrqEvent->bRet = I2C_ERR_SCL_HOLD_TOO_LONG;
-			pstIrqEvent->stIrqFlag.bActiveDone = 1;
-			wake_up(&pstSpI2CInfo->wait);
-			sp_i2cm_reset(sr);
-		} else if (pstIrqEvent->stIrqFlag.bRdOverflow) {
+			_sp_i2cm_fail(pstSpI2CInfo, I2C_ERR_SCL_HOLD_TOO_LONG);
+		} else if (pstIrqEvent->dFlags & I2C_IRQ_RD_OVERFLOW) {
 			DBG_ERR("I2C read data overflow !!\n");
-			pstIrqEvent->bRet = I2C_ERR_RDATA_OVERFLOW;
-			pstIrqEvent->stIrqFlag.bActiveDone = 1;
-			wake_up(&pstSpI2CInfo->wait);
-			sp_i2cm_reset(sr);
+			_sp_i2cm_fail(pstSpI2CInfo, I2C_ERR_RDATA_OVERFLOW);
 } else {
 	if ((pstIrqEvent->dBurstCount > 0) && (pstIrqEvent->eRWState == I2C_READ_STATE)) {
 		sp_i2cm_rdata_flag_get(sr, &rdata_flag);
-		for (i = 0; i < (32 / I2C_BURST_RDATA_BYTES); i++) {
-			bit_index = (I2C_BURST_RDATA_BYTES - 1) + (I2C_BURST_RDATA_BYTES * i);
-			if (rdata_flag & (1 << bit_index)) {
-				for (j = 0; j < (I2C_BURST_RDATA_BYTES/4); j++) {
-					k = pstIrqEvent->dRegDataIndex + j;
-					if (k >= 8)
-						k -= 8;
-
-					sp_i2cm_data_get(sr, k, (unsigned int *)(&pstIrqEvent->pDataBuf[pstIrqEvent->dDataIndex]));
-					pstIrqEvent->dDataIndex += 4;
-				}
-				sp_i2cm_rdata_flag_clear(sr, (((1 << I2C_BURST_RDATA_BYTES) - 1) << (I2C_BURST_RDATA_BYTES * i)));
-				pstIrqEvent->dRegDataIndex += (I2C_BURST_RDATA_BYTES / 4);
-				if (pstIrqEvent->dRegDataIndex >= 8)
-					pstIrqEvent->dBurstCount--;
+		// the FIFO is a ring, bursts complete in order from dRegDataIndex
+		for (i = 0; (i < ((I2C_FIFO_WORDS * 4) / burst_bytes)) && pstIrqEvent->dBurstCount; i++) {
+			bit_index = (pstIrqEvent->dRegDataIndex * 4) + (burst_bytes - 1);
+			if (!(rdata_flag & BIT(bit_index)))
+				break;
+
+			for (j = 0; j < (burst_bytes / 4); j++) {
+				k = pstIrqEvent->dRegDataIndex + j;
+				sp_i2cm_data_get(sr, k, (unsigned int *)(&pstIrqEvent->pDataBuf[pstIrqEvent->dDataIndex]));
+				pstIrqEvent->dDataIndex += 4;
 			}
+			sp_i2cm_rdata_flag_clear(sr, GENMASK(bit_index, bit_index - (burst_bytes - 1)));
+			pstIrqEvent->dRegDataIndex = (pstIrqEvent->dRegDataIndex + (burst_bytes / 4)) % I2C_FIFO_WORDS;
+			pstIrqEvent->dBurstCount--;
 		}
 	}
-		if (pstIrqEvent->stIrqFlag.bActiveDone) {
+		// a DMA read is complete when the data is in memory, below
+		if ((pstIrqEvent->dFlags & I2C_IRQ_DONE) && (pstIrqEvent->eRWState == I2C_READ_STATE)) {
 			if ((pstIrqEvent->dBurstRemainder) &&
 				(pstIrqEvent->eRWState == I2C_READ_STATE)) {
+				// the remainder sits in the words after the last full burst
 				j = 0;
-			for (i = 0; i < (I2C_BURST_RDATA_BYTES/4); i++) {
-				k = pstIrqEvent->dRegDataIndex + i;
-				if (k >= 8)
-					k -= 8;
-
+			for (i = 0; i < DIV_ROUND_UP(pstIrqEvent->dBurstRemainder, 4); i++) {
+				k = (pstIrqEvent->dRegDataIndex + i) % I2C_FIFO_WORDS;
 				sp_i2cm_data_get(sr, k, (unsigned int *)(&r_data[j]));
 				j += 4;
 			}
@@ -1132,8 +1238,7 @@ case I2C_DMA_READ_STATE:
 			}
 
 				DBG_INFO("I2C read success !!\n");
-				pstIrqEvent->bRet = I2C_SUCCESS;
-				wake_up(&pstSpI2CInfo->wait);
+				_sp_i2cm_complete(pstSpI2CInfo, I2C_SUCCESS);
 		}
 	}
 	break;
@@ -1143,24 +1248,24 @@ default:
 }
 	//switch case
 
-	_sp_i2cm_dma_intflag_check(pstSpI2CInfo, pstIrqEvent);
+	trace_sp7021_i2c_irq(pstSpI2CInfo->adap.nr, pstSpI2CInfo->stCmdInfo.dSlaveAddr,
+			     pstIrqEvent->eRWState, _sp_i2cm_trace_len(pstSpI2CInfo),
+			     pstIrqEvent->dDataIndex, pstIrqEvent->dFlags);
 
 	switch (pstIrqEvent->eRWState) {
 	case I2C_DMA_WRITE_STATE:
 			DBG_INFO("I2C_DMA_WRITE_STATE !!\n");
-			if (pstIrqEvent->stIrqDmaFlag.bDmaDone) {
+			if (pstIrqEvent->dFlags & I2C_IRQ_DMA_DONE) {
 				DBG_INFO("I2C dma write success !!\n");
-				pstIrqEvent->bRet = I2C_SUCCESS;
-				wake_up(&pstSpI2CInfo->wait);
+				_sp_i2cm_complete(pstSpI2CInfo, I2C_SUCCESS);
 			}
 			break;
 
 	case I2C_DMA_READ_STATE:
 			DBG_INFO("I2C_DMA_READ_STATE !!\n");
-			if (pstIrqEvent->stIrqDmaFlag.bDmaDone) {
+			if (pstIrqEvent->dFlags & I2C_IRQ_DMA_DONE) {
 				DBG_INFO("I2C dma read success !!\n");
-				pstIrqEvent->bRet = I2C_SUCCESS;
-				wake_up(&pstSpI2CInfo->wait);
+				_sp_i2cm_complete(pstSpI2CInfo, I2C_SUCCESS);
 			}
 			break;
 
@@ -1171,6 +1276,83 @@ default:
 	return IRQ_HANDLED;
 }
 
+/*
+ * Poll instead of sleeping when the context cannot sleep, or when the bus
+ * time is so short that the interrupt and wakeup would cost more than it.
+ * The line is masked for the whole transfer so only the poll loop runs the
+ * handler. Outside atomic context disable_irq() also waits for a handler
+ * still running on another CPU.
+ */
+static void _sp_i2cm_poll_begin(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+	struct I2C_Irq_Event_t_ *pstIrqEvent = &(pstSpI2CInfo->stIrqEvent);
+	unsigned int bytes, bus_us;
+
+	// address, payload and the repeated address of a restart, 9 clocks each
+	bytes = 1 + pstCmdInfo->dRestartEn + _sp_i2cm_trace_len(pstSpI2CInfo);
+	if (pstCmdInfo->dRestartEn)
+		bytes += pstCmdInfo->dWrDataCnt;
+	bus_us = (bytes * 9 * 1000) / max_t(unsigned int, pstCmdInfo->dFreq, 1);
+
+	pstIrqEvent->bPolled = pstSpI2CInfo->atomic || (bus_us <= I2C_POLL_MAX_US);
+	if (!pstIrqEvent->bPolled)
+		return;
+
+	if (pstSpI2CInfo->atomic)
+		disable_irq_nosync(pstSpI2CInfo->irq);
+	else
+		disable_irq(pstSpI2CInfo->irq);
+}
+
+static bool _sp_i2cm_pending(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct regs_i2cm_s *sr = (struct regs_i2cm_s *)pstSpI2CInfo->i2c_regs;
+	struct regs_i2cm_dma_s *sr_dma = (struct regs_i2cm_dma_s *)pstSpI2CInfo->i2c_dma_regs;
+
+	return sp_readl(&sr->interrupt) || sp_readl(&sr->i2cm_status3) ||
+	       sp_readl(&sr_dma->int_flag);
+}
+
+/*
+ * Wait for the completion like wait_event_timeout(), by polling if the
+ * transfer is. A polled transfer that outlasts its estimate, a target
+ * stretching SCL for instance, is only busy-waited for in atomic context,
+ * otherwise the poll sleeps between looks after I2C_POLL_SPIN_US.
+ */
+static long _sp_i2cm_wait(struct SpI2C_If_t_ *pstSpI2CInfo, long timeout)
+{
+	struct I2C_Irq_Event_t_ *pstIrqEvent = &(pstSpI2CInfo->stIrqEvent);
+	ktime_t now, spin_end, deadline;
+	long us = 0;
+
+	if (!pstIrqEvent->bPolled)
+		return wait_event_timeout(pstSpI2CInfo->wait,
+					  READ_ONCE(pstIrqEvent->bComplete), timeout);
+
+	now = ktime_get();
+	spin_end = ktime_add_us(now, I2C_POLL_SPIN_US);
+	deadline = ktime_add_us(now, jiffies_to_usecs(timeout));
+	for (;;) {
+		if (_sp_i2cm_pending(pstSpI2CInfo))
+			_sp_i2cm_irqevent_handler(pstSpI2CInfo->irq, pstSpI2CInfo);
+		if (READ_ONCE(pstIrqEvent->bComplete))
+			break;
+
+		now = ktime_get();
+		us = ktime_us_delta(deadline, now);
+		if (us <= 0)
+			break;
+		if (pstSpI2CInfo->atomic || ktime_before(now, spin_end))
+			udelay(I2C_POLL_DELAY_US);
+		else
+			usleep_range(I2C_POLL_SLEEP_US, 2 * I2C_POLL_SLEEP_US);
+	}
+	enable_irq(pstSpI2CInfo->irq);
+
+	return READ_ONCE(pstIrqEvent->bComplete) ? max(us, 1L) : 0;
+}
+
 #if IS_ENABLED(CONFIG_I2C_SLAVE)
 
 static irqreturn_t  _sp_i2cs_irqevent_handler_thread(int irq, void *args)
@@ -1387,9 +1569,17 @@ static int _sp_i2cm_get_resources(struct platform_device *pdev,
 {
 	int ret;
 	struct resource *res;
+	struct sp_i2cm_model_pdata *pdata = dev_get_platdata(&pdev->dev);
 
 	FUNC_DEBUG();
 
+	/* the software model hands over its register file directly */
+	if (pdata) {
+		pstSpI2CInfo->i2c_regs = pdata->i2c_regs;
+		pstSpI2CInfo->i2c_dma_regs = pdata->i2c_dma_regs;
+		return _sp_i2cm_get_irq(pdev, pstSpI2CInfo);
+	}
+
 	/* find and map our resources */
 	res = platform_get_resource_byname(pdev, IORESOURCE_MEM, I2CM_REG_NAME);
 	if (res) {
@@ -1448,7 +1638,7 @@ static int _sp_i2cs_get_resources(struct platform_device *pdev,
 
 	FUNC_DEBUG();
 
-	/* find I2C slave and map our resources */
+	/* find I2C slave and map our resources; only i2cm0 has a slave block */
 	res = platform_get_resource_byname(pdev, IORESOURCE_MEM, I2CS_REG_NAME);
 	if (res) {
 		pstSpI2CInfo->i2c_slave_regs =
@@ -1457,8 +1647,8 @@ static int _sp_i2cs_get_resources(struct platform_device *pdev,
 		if (IS_ERR(pstSpI2CInfo->i2c_slave_regs))
 			DBG_INFO("[I2C slave] platform_get_resource_byname fail\n");
 	} else {
-		DBG_ERR("[I2C slave] %s (%d)\n", __func__, __LINE__);
-		return -ENODEV;
+		DBG_INFO("[I2C slave] no slave block, master only\n");
+		return I2C_SUCCESS;
 	}
 
 	ret = _sp_i2cs_get_irq(pdev, pstSpI2CInfo);
@@ -1493,8 +1683,7 @@ int sp_i2cm_read(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2CInfo
 		return I2C_ERR_I2C_BUSY;
 	}
 
-	memset(pstIrqEvent, 0, sizeof(*pstIrqEvent));
-	pstIrqEvent->bI2CBusy = 1;
+	_sp_i2cm_event_begin(pstIrqEvent);
 
 	write_cnt = pstCmdInfo->dWrDataCnt;
 	read_cnt = pstCmdInfo->dRdDataCnt;
@@ -1514,38 +1703,34 @@ int sp_i2cm_read(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2CInfo
 		return I2C_ERR_INVALID_CNT;
 	}
 
-	burst_cnt = read_cnt / I2C_BURST_RDATA_BYTES;
-	burst_r = read_cnt % I2C_BURST_RDATA_BYTES;
+	burst_cnt = read_cnt / pstSpI2CInfo->dBurstBytes;
+	burst_r = read_cnt % pstSpI2CInfo->dBurstBytes;
 	DBG_INFO("write_cnt = %d, read_cnt = %d, burst_cnt = %d, burst_r = %d\n",
 			write_cnt, read_cnt, burst_cnt, burst_r);
 
 	int0 = (I2C_EN0_SCL_HOLD_TOO_LONG_INT | I2C_EN0_EMPTY_INT | I2C_EN0_DATA_NACK_INT
 			| I2C_EN0_ADDRESS_NACK_INT | I2C_EN0_DONE_INT);
 	if (burst_cnt) {
-		int1 = I2C_BURST_RDATA_FLAG;
+		int1 = I2C_BURST_RDATA_FLAG(pstSpI2CInfo->dBurstBytes);
 		int2 = I2C_BURST_RDATA_ALL_FLAG;
 	}
 
 	pstIrqEvent->eRWState = I2C_READ_STATE;
+	pstIrqEvent->dIntEn = int0;
+	pstIrqEvent->dBurstBytes = pstSpI2CInfo->dBurstBytes;
 	pstIrqEvent->dBurstCount = burst_cnt;
 	pstIrqEvent->dBurstRemainder = burst_r;
 	pstIrqEvent->dDataIndex = 0;
 	pstIrqEvent->dRegDataIndex = 0;
 	pstIrqEvent->dDataTotalLen = read_cnt;
 	pstIrqEvent->pDataBuf = pstCmdInfo->pRdData;
+	_sp_i2cm_trace_xfer(pstSpI2CInfo, false);
+	_sp_i2cm_poll_begin(pstSpI2CInfo);
 
 	//hal_i2cm_reset(pstCmdInfo->dDevId);
 	sp_i2cm_reset(sr);
-	sp_i2cm_clock_freq_set(sr, pstCmdInfo->dFreq);
+	sp_i2cm_timing_set(sr, pstCmdInfo->pstTiming);
 	sp_i2cm_slave_addr_set(sr, pstCmdInfo->dSlaveAddr);
-	#ifdef I2C_RETEST
-	if ((test_count > 1) && (test_count%3 == 0)) {
-		sp_i2cm_scl_delay_set(sr, 0x01);
-		DBG_INFO("test_count = %d", test_count);
-	} else {
-		sp_i2cm_scl_delay_set(sr, I2C_SCL_DELAY);
-	}
-	#endif
 	sp_i2cm_trans_cnt_set(sr, write_cnt, read_cnt);
 	sp_i2cm_active_mode_set(sr, I2C_TRIGGER);
 
@@ -1564,15 +1749,19 @@ int sp_i2cm_read(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2CInfo
 	sp_i2cm_int_en0_set(sr, int0);
 	sp_i2cm_int_en1_set(sr, int1);
 	sp_i2cm_int_en2_set(sr, int2);
+	_sp_i2cm_trace_xfer(pstSpI2CInfo, true);
+	pstIrqEvent->tTrigger = ktime_get();
 	sp_i2cm_manual_trigger(sr);	//start send data
 
-	ret = wait_event_timeout(pstSpI2CInfo->wait, pstIrqEvent->stIrqFlag.bActiveDone, (I2C_SLEEP_TIMEOUT * HZ) / 500);
+	ret = _sp_i2cm_wait(pstSpI2CInfo, (I2C_SLEEP_TIMEOUT * HZ) / 500);
 	if (ret == 0) {
 		DBG_ERR("I2C read timeout !!\n");
 		ret = I2C_ERR_TIMEOUT_OUT;
 	} else {
 		ret = pstIrqEvent->bRet;
 	}
+	_sp_i2cm_trace_wakeup(pstSpI2CInfo, ret);
+	_sp_i2cm_calib_xfer(pstSpI2CInfo, ret);
 	sp_i2cm_reset(sr);
 	pstIrqEvent->eRWState = I2C_IDLE_STATE;
 	pstIrqEvent->bI2CBusy = 0;
@@ -1601,8 +1790,7 @@ int sp_i2cm_write(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2CInf
 		return I2C_ERR_I2C_BUSY;
 	}
 
-	memset(pstIrqEvent, 0, sizeof(*pstIrqEvent));
-	pstIrqEvent->bI2CBusy = 1;
+	_sp_i2cm_event_begin(pstIrqEvent);
 
 	write_cnt = pstCmdInfo->dWrDataCnt;
 
@@ -1631,22 +1819,17 @@ int sp_i2cm_write(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2CInf
 		int0 |= I2C_EN0_EMPTY_THRESHOLD_INT;
 
 	pstIrqEvent->eRWState = I2C_WRITE_STATE;
+	pstIrqEvent->dIntEn = int0;
 	pstIrqEvent->dBurstCount = burst_cnt;
 	pstIrqEvent->dDataIndex = i;
 	pstIrqEvent->dDataTotalLen = write_cnt;
 	pstIrqEvent->pDataBuf = pstCmdInfo->pWrData;
+	_sp_i2cm_trace_xfer(pstSpI2CInfo, false);
+	_sp_i2cm_poll_begin(pstSpI2CInfo);
 
 	sp_i2cm_reset(sr);
-	sp_i2cm_clock_freq_set(sr, pstCmdInfo->dFreq);
+	sp_i2cm_timing_set(sr, pstCmdInfo->pstTiming);
 	sp_i2cm_slave_addr_set(sr, pstCmdInfo->dSlaveAddr);
-	#ifdef I2C_RETEST
-	if ((test_count > 1) && (test_count%3 == 0)) {
-		DBG_INFO("test_count = %d", test_count);
-		sp_i2cm_scl_delay_set(sr, 0x01);
-	} else {
-		sp_i2cm_scl_delay_set(sr, I2C_SCL_DELAY);
-	}
-	#endif
 	sp_i2cm_trans_cnt_set(sr, write_cnt, 0);
 	sp_i2cm_active_mode_set(sr, I2C_TRIGGER);
 	sp_i2cm_rw_mode_set(sr, I2C_WRITE_MODE);
@@ -1657,16 +1840,19 @@ int sp_i2cm_write(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2CInf
 	else
 		sp_i2cm_int_en0_set(sr, int0);
 
+	_sp_i2cm_trace_xfer(pstSpI2CInfo, true);
+	pstIrqEvent->tTrigger = ktime_get();
 	sp_i2cm_manual_trigger(sr);	//start send data
 
-	ret = wait_event_timeout(pstSpI2CInfo->wait,
-	pstIrqEvent->stIrqFlag.bActiveDone, (I2C_SLEEP_TIMEOUT * HZ) / 500);
+	ret = _sp_i2cm_wait(pstSpI2CInfo, (I2C_SLEEP_TIMEOUT * HZ) / 500);
 	if (ret == 0) {
 		DBG_ERR("I2C write timeout !!\n");
 		ret = I2C_ERR_TIMEOUT_OUT;
 	} else {
 		ret = pstIrqEvent->bRet;
 	}
+	_sp_i2cm_trace_wakeup(pstSpI2CInfo, ret);
+	_sp_i2cm_calib_xfer(pstSpI2CInfo, ret);
 	sp_i2cm_reset(sr);
 	pstIrqEvent->eRWState = I2C_IDLE_STATE;
 	pstIrqEvent->bI2CBusy = 0;
@@ -1680,7 +1866,6 @@ int sp_i2cm_dma_write(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2
 	struct regs_i2cm_s *sr = (struct regs_i2cm_s *)pstSpI2CInfo->i2c_regs;
 	struct regs_i2cm_dma_s *sr_dma = (struct regs_i2cm_dma_s *)pstSpI2CInfo->i2c_dma_regs;
 	struct I2C_Irq_Event_t_ *pstIrqEvent = &(pstSpI2CInfo->stIrqEvent);
-	struct Moon_RegBase_s *pstMoonRegBase = &stMoonRegBase;
 	unsigned int int0 = 0;
 	int ret = I2C_SUCCESS;
 	unsigned int dma_int = 0;
@@ -1692,18 +1877,12 @@ int sp_i2cm_dma_write(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2
 	if (pstCmdInfo->dDevId > I2C_MASTER_NUM)
 		return I2C_ERR_INVALID_DEVID;
 
-	if (pstSpI2CInfo->mode == I2C_POWER_ALL_SWITCH) {
-		pstMoonRegBase->moon0_regs = (void __iomem *)MOON0_BASE;
-		sp_i2cm_enable(0, pstMoonRegBase->moon0_regs);
-	}
-
 	if (pstIrqEvent->bI2CBusy) {
 		DBG_ERR("I2C is busy !!\n");
 		return I2C_ERR_I2C_BUSY;
 	}
 
-	memset(pstIrqEvent, 0, sizeof(*pstIrqEvent));
-	pstIrqEvent->bI2CBusy = 1;
+	_sp_i2cm_event_begin(pstIrqEvent);
 
 	if (pstCmdInfo->dWrDataCnt > 0xFFFF) {
 		pstIrqEvent->bI2CBusy = 0;
@@ -1715,6 +1894,8 @@ int sp_i2cm_dma_write(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2
 	DBG_INFO(" DMA DataCnt = %d\n", pstCmdInfo->dWrDataCnt);
 
 	pstIrqEvent->eRWState = I2C_DMA_WRITE_STATE;
+	_sp_i2cm_trace_xfer(pstSpI2CInfo, false);
+	_sp_i2cm_poll_begin(pstSpI2CInfo);
 
 	dma_w_addr = dma_map_single(pstSpI2CInfo->dev, pstCmdInfo->pWrData,
 			pstCmdInfo->dWrDataCnt, DMA_TO_DEVICE);
@@ -1730,21 +1911,14 @@ int sp_i2cm_dma_write(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2
 
 
 	dma_int = I2C_DMA_EN_DMA_DONE_INT;
-
+	pstIrqEvent->dIntEn = int0;
+	pstIrqEvent->dDmaIntEn = dma_int;
 
 	sp_i2cm_reset(sr);
 	sp_i2cm_dma_mode_enable(sr);
-	sp_i2cm_clock_freq_set(sr, pstCmdInfo->dFreq);
+	sp_i2cm_timing_set(sr, pstCmdInfo->pstTiming);
 	sp_i2cm_slave_addr_set(sr, pstCmdInfo->dSlaveAddr);
 
-	#ifdef I2C_RETEST
-	if ((test_count > 1) && (test_count%3 == 0)) {
-		DBG_INFO("test_count = %d", test_count);
-		sp_i2cm_scl_delay_set(sr, 0x01);
-	} else {
-		sp_i2cm_scl_delay_set(sr, I2C_SCL_DELAY);
-	}
-	#endif
 	sp_i2cm_active_mode_set(sr, I2C_AUTO);
 	sp_i2cm_rw_mode_set(sr, I2C_WRITE_MODE);
 	sp_i2cm_int_en0_set(sr, int0);
@@ -1753,17 +1927,22 @@ int sp_i2cm_dma_write(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2
 	sp_i2cm_dma_length_set(sr_dma, pstCmdInfo->dWrDataCnt);
 	sp_i2cm_dma_rw_mode_set(sr_dma, I2C_DMA_READ_MODE);
 	sp_i2cm_dma_int_en_set(sr_dma, dma_int);
+	_sp_i2cm_trace_xfer(pstSpI2CInfo, true);
+	pstIrqEvent->tTrigger = ktime_get();
 	sp_i2cm_dma_go_set(sr_dma);
 
 
-	ret = wait_event_timeout(pstSpI2CInfo->wait, pstIrqEvent->stIrqDmaFlag.bDmaDone, (I2C_SLEEP_TIMEOUT * HZ) / 200);
+	ret = _sp_i2cm_wait(pstSpI2CInfo, (I2C_SLEEP_TIMEOUT * HZ) / 200);
 	if (ret == 0) {
 		DBG_ERR("I2C DMA write timeout !!\n");
 		ret = I2C_ERR_TIMEOUT_OUT;
 	} else {
 		ret = pstIrqEvent->bRet;
 	}
+	_sp_i2cm_trace_wakeup(pstSpI2CInfo, ret);
+	_sp_i2cm_calib_xfer(pstSpI2CInfo, ret);
 	sp_i2cm_status_clear(sr, 0xFFFFFFFF);
+	sp_i2cm_dma_int_flag_clear(sr_dma, 0x7F);  //write 1 to clear
 
 	if (dma_w_addr != pstSpI2CInfo->dma_phy_base)
 		dma_unmap_single(pstSpI2CInfo->dev, dma_w_addr,
@@ -1785,7 +1964,6 @@ int sp_i2cm_dma_read(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2C
 	struct regs_i2cm_dma_s *sr_dma = (struct regs_i2cm_dma_s *)pstSpI2CInfo->i2c_dma_regs;
 	struct I2C_Irq_Event_t_ *pstIrqEvent = &(pstSpI2CInfo->stIrqEvent);
 
-	struct Moon_RegBase_s *pstMoonRegBase = &stMoonRegBase;
 	unsigned char w_data[32] = {0};
 	unsigned int read_cnt = 0;
 	unsigned int write_cnt = 0;
@@ -1800,19 +1978,12 @@ int sp_i2cm_dma_read(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2C
 	if (pstCmdInfo->dDevId > I2C_MASTER_NUM)
 		return I2C_ERR_INVALID_DEVID;
 
-	if (pstSpI2CInfo->mode == I2C_POWER_ALL_SWITCH) {
-		pstMoonRegBase->moon0_regs = (void __iomem *)MOON0_BASE;
-		sp_i2cm_enable(0, pstMoonRegBase->moon0_regs);
-	}
-
-
 	if (pstIrqEvent->bI2CBusy) {
 		DBG_ERR("I2C is busy !!\n");
 		return I2C_ERR_I2C_BUSY;
 	}
 
-	memset(pstIrqEvent, 0, sizeof(*pstIrqEvent));
-	pstIrqEvent->bI2CBusy = 1;
+	_sp_i2cm_event_begin(pstIrqEvent);
 
 	write_cnt = pstCmdInfo->dWrDataCnt;
 	read_cnt = pstCmdInfo->dRdDataCnt;
@@ -1850,24 +2021,20 @@ int sp_i2cm_dma_read(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2C
 	dma_int = I2C_DMA_EN_DMA_DONE_INT;
 
 	pstIrqEvent->eRWState = I2C_DMA_READ_STATE;
+	pstIrqEvent->dIntEn = int0;
+	pstIrqEvent->dDmaIntEn = dma_int;
 
 	pstIrqEvent->dDataIndex = 0;
 	pstIrqEvent->dRegDataIndex = 0;
 	pstIrqEvent->dDataTotalLen = read_cnt;
+	_sp_i2cm_trace_xfer(pstSpI2CInfo, false);
+	_sp_i2cm_poll_begin(pstSpI2CInfo);
 
 	sp_i2cm_reset(sr);
 	sp_i2cm_dma_mode_enable(sr);
-	sp_i2cm_clock_freq_set(sr, pstCmdInfo->dFreq);
+	sp_i2cm_timing_set(sr, pstCmdInfo->pstTiming);
 	sp_i2cm_slave_addr_set(sr, pstCmdInfo->dSlaveAddr);
 
-	#ifdef I2C_RETEST
-	if ((test_count > 1) && (test_count%3 == 0)) {
-		DBG_INFO("test_count = %d", test_count);
-		sp_i2cm_scl_delay_set(sr, 0x01);
-	} else {
-		sp_i2cm_scl_delay_set(sr, I2C_SCL_DELAY);
-	}
-	#endif
 
 	if (pstCmdInfo->dRestartEn) {
 		DBG_INFO("I2C_RESTART_MODE\n");
@@ -1892,21 +2059,32 @@ int sp_i2cm_dma_read(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2C
 	sp_i2cm_dma_length_set(sr_dma, pstCmdInfo->dRdDataCnt);
 	sp_i2cm_dma_rw_mode_set(sr_dma, I2C_DMA_WRITE_MODE);
 	sp_i2cm_dma_int_en_set(sr_dma, dma_int);
+	// in restart mode the manual trigger starts the bus, DMA go only arms it
+	if (!pstCmdInfo->dRestartEn) {
+		_sp_i2cm_trace_xfer(pstSpI2CInfo, true);
+		pstIrqEvent->tTrigger = ktime_get();
+	}
 	sp_i2cm_dma_go_set(sr_dma);
 
 
-	if (pstCmdInfo->dRestartEn)
+	if (pstCmdInfo->dRestartEn) {
+		_sp_i2cm_trace_xfer(pstSpI2CInfo, true);
+		pstIrqEvent->tTrigger = ktime_get();
 		sp_i2cm_manual_trigger(sr); //start send data
+	}
 
 
-	ret = wait_event_timeout(pstSpI2CInfo->wait, pstIrqEvent->stIrqDmaFlag.bDmaDone, (I2C_SLEEP_TIMEOUT * HZ) / 200);
+	ret = _sp_i2cm_wait(pstSpI2CInfo, (I2C_SLEEP_TIMEOUT * HZ) / 200);
 	if (ret == 0) {
 		DBG_ERR("I2C DMA read timeout !!\n");
 		ret = I2C_ERR_TIMEOUT_OUT;
 	} else {
 		ret = pstIrqEvent->bRet;
 	}
+	_sp_i2cm_trace_wakeup(pstSpI2CInfo, ret);
+	_sp_i2cm_calib_xfer(pstSpI2CInfo, ret);
 	sp_i2cm_status_clear(sr, 0xFFFFFFFF);
+	sp_i2cm_dma_int_flag_clear(sr_dma, 0x7F);  //write 1 to clear
 
 	//copy data from virtual addr to pstCmdInfo->pRdData
 
@@ -1925,205 +2103,1846 @@ int sp_i2cm_dma_read(struct I2C_Cmd_t_ *pstCmdInfo, struct SpI2C_If_t_ *pstSpI2C
 
 
 
-static int sp_master_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+static void _sp_i2cm_timing_calc(struct SpI2C_If_t_ *pstSpI2CInfo,
+				 struct I2C_Timing_t_ *pstTiming, unsigned int bus_freq)
 {
-	struct SpI2C_If_t_ *pstSpI2CInfo = adap->algo_data;
-	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
-	int ret = I2C_SUCCESS;
-	int i = 0;
-	unsigned char restart_w_data[32] = {0};
-	unsigned int  restart_write_cnt = 0;
-	unsigned int  restart_en = 0;
+	struct i2c_timings *t = &pstSpI2CInfo->timings;
+	unsigned long src = pstSpI2CInfo->src_clk_rate;
+	unsigned int period_ns, edges_ns, hold_ns;
+	unsigned int div, delay;
+	u64 cycles;
+
+	/* the divider counts the whole period, the line edges come on top */
+	period_ns = NSEC_PER_SEC / bus_freq;
+	edges_ns = t->scl_rise_ns + t->scl_fall_ns;
+	if (edges_ns < period_ns / 2)
+		period_ns -= edges_ns;
+
+	cycles = DIV_ROUND_UP_ULL((u64)src * period_ns, NSEC_PER_SEC);
+	div = clamp_t(u64, cycles, 2, I2C_CTL2_FREQ_CUSTOM_MASK + 1) - 1;
+
+	/*
+	 * Above fast mode the low phase is only a dozen source clocks, so
+	 * SDA is moved to the middle of it instead of a fixed delay after
+	 * the falling SCL edge. Do the same when the firmware asks for more
+	 * hold time than the delay gives.
+	 */
+	delay = (bus_freq > I2C_MAX_FAST_MODE_FREQ) ? 0 : I2C_SCL_DELAY;
+	hold_ns = DIV_ROUND_UP_ULL((u64)delay * NSEC_PER_SEC, src);
+
+	pstTiming->dBusFreq = bus_freq;
+	pstTiming->dFreq = src / (1000 * (div + 1));
+	pstTiming->dCtl2 = I2C_CTL2_FREQ_CUSTOM(div) | I2C_CTL2_SCL_DELAY(delay);
+	if (bus_freq > I2C_MAX_FAST_MODE_FREQ || t->sda_hold_ns > hold_ns)
+		pstTiming->dCtl2 |= I2C_CTL2_SDA_HALF_ENABLE;
+}
 
-	FUNC_DEBUG();
+static void _sp_i2cm_timing_init(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	static const unsigned int speeds[] = {
+		[I2C_SPEED_STANDARD] = I2C_MAX_STANDARD_MODE_FREQ,
+		[I2C_SPEED_FAST] = I2C_MAX_FAST_MODE_FREQ,
+		[I2C_SPEED_FAST_PLUS] = I2C_MAX_FAST_MODE_PLUS_FREQ,
+	};
+	struct i2c_timings *t = &pstSpI2CInfo->timings;
+	struct I2C_Timing_t_ *pstTiming;
+	int i;
+
+	pstSpI2CInfo->src_clk_rate = clk_get_rate(pstSpI2CInfo->clk);
+	if (!pstSpI2CInfo->src_clk_rate)
+		pstSpI2CInfo->src_clk_rate = I2C_CLK_SOURCE_FREQ * 1000;
+
+	i2c_parse_fw_timings(pstSpI2CInfo->dev, t, false);
+	if (!t->bus_freq_hz)
+		t->bus_freq_hz = I2C_FREQ * 1000;
+	if (t->bus_freq_hz > I2C_MAX_FAST_MODE_PLUS_FREQ) {
+		dev_warn(pstSpI2CInfo->dev, "clock-frequency %u not supported, using %u\n",
+			 t->bus_freq_hz, I2C_MAX_FAST_MODE_PLUS_FREQ);
+		t->bus_freq_hz = I2C_MAX_FAST_MODE_PLUS_FREQ;
+	}
+	pstSpI2CInfo->i2c_clk_freq = t->bus_freq_hz;
 
-#ifdef CONFIG_PM_RUNTIME_I2C
-	ret = pm_runtime_get_sync(&adap->dev);
-	if (ret < 0)
-		goto out;
-#endif
-	if (num == 0)
-		return -EINVAL;
+	for (i = 0; i < ARRAY_SIZE(speeds); i++)
+		_sp_i2cm_timing_calc(pstSpI2CInfo, &pstSpI2CInfo->stTiming[i], speeds[i]);
+	_sp_i2cm_timing_calc(pstSpI2CInfo, &pstSpI2CInfo->stTiming[I2C_SPEED_BUS],
+			     t->bus_freq_hz);
 
-	memset(pstCmdInfo, 0, sizeof(*pstCmdInfo));
-	pstCmdInfo->dDevId = adap->nr;
+	for (i = 0; i < I2C_SPEED_NUM; i++) {
+		pstTiming = &pstSpI2CInfo->stTiming[i];
+		dev_dbg(pstSpI2CInfo->dev, "timing %d: %u Hz -> %u kHz, ctl2 0x%08x\n",
+			i, pstTiming->dBusFreq, pstTiming->dFreq, pstTiming->dCtl2);
+	}
+}
 
-	if (pstCmdInfo->dFreq > I2C_FREQ)
-		pstCmdInfo->dFreq = I2C_FREQ;
-	else
-		pstCmdInfo->dFreq = pstSpI2CInfo->i2c_clk_freq/1000;
+/* the fastest table entry not above bus_freq, I2C_SPEED_NUM if all are */
+static enum I2C_Speed_e_ _sp_i2cm_speed_find(struct SpI2C_If_t_ *pstSpI2CInfo,
+					      unsigned int bus_freq)
+{
+	struct I2C_Timing_t_ *pstTiming = pstSpI2CInfo->stTiming;
+	enum I2C_Speed_e_ best = I2C_SPEED_NUM;
+	int i;
 
-	DBG_INFO("[I2C] set freq : %d\n", pstCmdInfo->dFreq);
+	for (i = 0; i < I2C_SPEED_NUM; i++) {
+		if (pstTiming[i].dBusFreq > bus_freq)
+			continue;
+		if (best == I2C_SPEED_NUM || pstTiming[i].dBusFreq > pstTiming[best].dBusFreq)
+			best = i;
+	}
 
-	for (i = 0; i < num; i++) {
-		if (msgs[i].flags & I2C_M_TEN)
-			return -EINVAL;
+	return best;
+}
 
-		pstCmdInfo->dSlaveAddr = msgs[i].addr;
+/*
+ * Targets may run at another speed than the adapter, set by the standard
+ * "clock-frequency" property of their device tree node or by
+ * sp_i2c_set_target_speed(). A bus_freq of 0 returns to the adapter speed.
+ * A bus_freq below every precomputed speed cannot be honoured and is
+ * refused. The calibration starts over from the new speed.
+ */
+static int _sp_i2cm_target_speed_set(struct SpI2C_If_t_ *pstSpI2CInfo, u16 addr,
+				     u32 bus_freq)
+{
+	enum I2C_Speed_e_ speed = I2C_SPEED_BUS;
 
-		if (msgs[i].flags & I2C_M_NOSTART) {
+	if (addr >= I2C_TARGET_NUM)
+		return -EINVAL;
+	if (bus_freq > I2C_MAX_FAST_MODE_PLUS_FREQ)
+		return -ERANGE;
+
+	if (bus_freq) {
+		speed = _sp_i2cm_speed_find(pstSpI2CInfo, bus_freq);
+		if (speed == I2C_SPEED_NUM)
+			return -ERANGE;
+	}
+	_sp_i2cm_target_reset(pstSpI2CInfo, &pstSpI2CInfo->stTarget[addr], speed);
+
+	return 0;
+}
+
+/*
+ * The clients are not devices yet, so i2c_parse_fw_timings() cannot be used
+ * on them. Their "clock-frequency" is the same property it reads.
+ */
+static void _sp_i2cm_target_speed_init(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct device_node *child;
+	u32 addr, bus_freq;
+	int ret, i;
+
+	for (i = 0; i < I2C_TARGET_NUM; i++)
+		_sp_i2cm_target_reset(pstSpI2CInfo, &pstSpI2CInfo->stTarget[i], I2C_SPEED_BUS);
+
+	for_each_available_child_of_node(pstSpI2CInfo->dev->of_node, child) {
+		if (of_property_read_u32(child, "reg", &addr) ||
+		    of_property_read_u32(child, "clock-frequency", &bus_freq))
+			continue;
+
+		ret = _sp_i2cm_target_speed_set(pstSpI2CInfo, addr, bus_freq);
+		if (ret)
+			dev_warn(pstSpI2CInfo->dev, "%pOF: bus frequency %u not applied: %d\n",
+				 child, bus_freq, ret);
+	}
+}
+
+static void _sp_i2cm_cmd_init(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+
+	memset(pstCmdInfo, 0, sizeof(*pstCmdInfo));
+	pstCmdInfo->dDevId = pstSpI2CInfo->adap.nr;
+	pstCmdInfo->bFirst = 1;
+
+	pstCmdInfo->pstTiming = &pstSpI2CInfo->stTiming[I2C_SPEED_BUS];
+	pstCmdInfo->dFreq = pstCmdInfo->pstTiming->dFreq;
+}
+
+static void _sp_i2cm_cmd_target(struct SpI2C_If_t_ *pstSpI2CInfo, u16 addr)
+{
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+
+	pstCmdInfo->dSlaveAddr = addr;
+	if (addr < I2C_TARGET_NUM)
+		pstCmdInfo->pstTiming = &pstSpI2CInfo->stTarget[addr].stTiming;
+	else
+		pstCmdInfo->pstTiming = &pstSpI2CInfo->stTiming[I2C_SPEED_BUS];
+	pstCmdInfo->dFreq = pstCmdInfo->pstTiming->dFreq;
+}
+
+/* debugfs directory of the driver, one directory per adapter below it */
+static struct dentry *sp_i2c_debugfs;
+
+static unsigned int retry_backoff_us = 100;
+module_param(retry_backoff_us, uint, 0644);
+MODULE_PARM_DESC(retry_backoff_us, "delay before the first retry of a failed transaction, doubled for each further one");
+
+/* SDA held low by a target with the controller reset, sampled on the GPIO */
+static bool _sp_i2cm_bus_stuck(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct i2c_bus_recovery_info *bri = pstSpI2CInfo->adap.bus_recovery_info;
+	bool stuck;
+
+	// pin switching may sleep
+	if (!bri || !bri->sda_gpiod || pstSpI2CInfo->atomic)
+		return false;
+
+	pinctrl_select_state(bri->pinctrl, bri->pins_gpio);
+	stuck = !gpiod_get_value_cansleep(bri->sda_gpiod);
+	pinctrl_select_state(bri->pinctrl, bri->pins_default);
+
+	return stuck;
+}
+
+/*
+ * Errors a second attempt can fix without repeating anything the target
+ * acted on. A target that acknowledged before and now NACKs its address
+ * is briefly busy (an EEPROM write cycle) and has seen nothing of the
+ * message, so that is retried wherever it happens. A stuck or glitched
+ * bus is only retried on a read that opens the transfer: a write may have
+ * had data bytes acknowledged, which must not reach a FIFO or command
+ * register twice, and a later message would run again after the earlier
+ * ones of the transfer already took effect. Data NACKs are the target's
+ * answer and a NACK of an unknown address is most likely no device at
+ * all, neither is retried. A timeout alone says nothing about the bus,
+ * it is only retried when SDA is found stuck.
+ */
+static bool _sp_i2cm_retryable(struct SpI2C_If_t_ *pstSpI2CInfo, int ret)
+{
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+	unsigned int addr = pstCmdInfo->dSlaveAddr;
+
+	if (ret == I2C_ERR_RECEIVE_NACK)
+		return (pstSpI2CInfo->stIrqEvent.dFlags & I2C_IRQ_ADDR_NACK) &&
+		       (addr < I2C_TARGET_NUM) && pstSpI2CInfo->stTarget[addr].bSeen;
+
+	if (!pstCmdInfo->dRdDataCnt || !pstCmdInfo->bFirst)
+		return false;
+
+	switch (ret) {
+	case I2C_ERR_TIMEOUT_OUT:
+		return _sp_i2cm_bus_stuck(pstSpI2CInfo);
+	case I2C_ERR_SCL_HOLD_TOO_LONG:
+	case I2C_ERR_FIFO_EMPTY:
+	case I2C_ERR_RDATA_OVERFLOW:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* Clock a target holding SDA low out of its byte, then restart the controller */
+static void _sp_i2cm_recover(struct SpI2C_If_t_ *pstSpI2CInfo, int ret)
+{
+	struct regs_i2cm_s *sr = (struct regs_i2cm_s *)pstSpI2CInfo->i2c_regs;
+
+	// pin switching may sleep, atomic transfers only get the retry
+	if (!pstSpI2CInfo->adap.bus_recovery_info || pstSpI2CInfo->atomic)
+		return;
+	if ((ret != I2C_ERR_TIMEOUT_OUT) && (ret != I2C_ERR_SCL_HOLD_TOO_LONG) &&
+	    (ret != I2C_ERR_FIFO_EMPTY))
+		return;
+
+	if (i2c_recover_bus(&pstSpI2CInfo->adap) == 0)
+		atomic64_inc(&pstSpI2CInfo->stStats.recoveries);
+	sp_i2cm_reset(sr);
+}
+
+/*
+ * Account the result of a transaction once, after any retries; the error
+ * class is the one of the last attempt. Retries have their own counter.
+ */
+static void _sp_i2cm_stats_xfer(struct SpI2C_If_t_ *pstSpI2CInfo,
+				int (*xfer)(struct I2C_Cmd_t_ *, struct SpI2C_If_t_ *), int ret)
+{
+	struct I2C_Irq_Event_t_ *pstIrqEvent = &(pstSpI2CInfo->stIrqEvent);
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+	struct I2C_Stats_t_ *pstStats = &(pstSpI2CInfo->stStats);
+	bool read = (xfer == sp_i2cm_read) || (xfer == sp_i2cm_dma_read);
+	u32 bytes = read ? pstCmdInfo->dRdDataCnt : pstCmdInfo->dWrDataCnt;
+
+	atomic64_inc(&pstStats->transfers);
+	if ((xfer == sp_i2cm_dma_read) || (xfer == sp_i2cm_dma_write))
+		atomic64_inc(&pstStats->dma);
+	else
+		atomic64_inc(&pstStats->pio);
+
+	if (read && pstCmdInfo->dRestartEn) {
+		atomic64_inc(&pstStats->restarts);
+		bytes += pstCmdInfo->dWrDataCnt;
+	}
+
+	switch (ret) {
+	case I2C_SUCCESS:
+		atomic64_add(bytes, &pstStats->bytes);
+		break;
+	case I2C_ERR_RECEIVE_NACK:
+		if (pstIrqEvent->dFlags & I2C_IRQ_ADDR_NACK)
+			atomic64_inc(&pstStats->addr_nacks);
+		else
+			atomic64_inc(&pstStats->data_nacks);
+		break;
+	case I2C_ERR_SCL_HOLD_TOO_LONG:
+		atomic64_inc(&pstStats->scl_hold);
+		break;
+	case I2C_ERR_FIFO_EMPTY:
+		atomic64_inc(&pstStats->fifo_empty);
+		break;
+	case I2C_ERR_RDATA_OVERFLOW:
+		atomic64_inc(&pstStats->overflows);
+		break;
+	case I2C_ERR_TIMEOUT_OUT:
+		atomic64_inc(&pstStats->timeouts);
+		break;
+	}
+}
+
+/*
+ * Run the transaction in stCmdInfo, retrying failures that may pass on a
+ * second attempt up to adap.retries times (I2C_RETRIES), with a backoff
+ * doubling from retry_backoff_us.
+ */
+static int _sp_i2cm_run(struct SpI2C_If_t_ *pstSpI2CInfo,
+			int (*xfer)(struct I2C_Cmd_t_ *, struct SpI2C_If_t_ *))
+{
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+	unsigned int backoff = READ_ONCE(retry_backoff_us);
+	int retry;
+	int ret;
+
+	for (retry = 0; ; retry++) {
+		ret = xfer(pstCmdInfo, pstSpI2CInfo);
+		if ((ret == I2C_SUCCESS) || (retry >= pstSpI2CInfo->adap.retries) ||
+		    !_sp_i2cm_retryable(pstSpI2CInfo, ret)) {
+			_sp_i2cm_stats_xfer(pstSpI2CInfo, xfer, ret);
+			return ret;
+		}
+
+		atomic64_inc(&pstSpI2CInfo->stStats.retries);
+		_sp_i2cm_recover(pstSpI2CInfo, ret);
+
+		backoff = min_t(unsigned int, backoff, I2C_RETRY_BACKOFF_MAX_US);
+		if (pstSpI2CInfo->atomic)
+			udelay(backoff);
+		else
+			fsleep(backoff);
+		backoff *= 2;
+	}
+}
+
+static int _sp_i2cm_master_xfer(struct SpI2C_If_t_ *pstSpI2CInfo, struct i2c_msg *msgs, int num)
+{
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+	struct i2c_msg *wr_msg;
+	int ret = I2C_SUCCESS;
+	int i = 0;
+
+	FUNC_DEBUG();
+
+	if (num == 0)
+		return -EINVAL;
+
+	_sp_i2cm_cmd_init(pstSpI2CInfo);
+
+	for (i = 0; i < num; i++) {
+		if (msgs[i].flags & (I2C_M_TEN | I2C_M_NOSTART))
+			return -EINVAL;
+
+		_sp_i2cm_cmd_target(pstSpI2CInfo, msgs[i].addr);
+		pstCmdInfo->dRestartEn = 0;
+		wr_msg = NULL;
+
+		/*
+		 * A write followed by a read of the same target, the usual register
+		 * read, runs as one restart transaction. The write part goes through
+		 * the data registers, so it is limited to the 32 byte FIFO.
+		 */
+		if (!(msgs[i].flags & I2C_M_RD) && (i + 1 < num) &&
+		    (msgs[i + 1].flags & I2C_M_RD) &&
+		    !(msgs[i + 1].flags & (I2C_M_TEN | I2C_M_NOSTART)) &&
+		    (msgs[i + 1].addr == msgs[i].addr) &&
+		    msgs[i].len && (msgs[i].len <= 32)) {
+			wr_msg = &msgs[i];
+			i++;
+		}
+
+		if (msgs[i].flags & I2C_M_RD) {
+			if (wr_msg) {
+				pstCmdInfo->dWrDataCnt = wr_msg->len;
+				pstCmdInfo->pWrData = wr_msg->buf;
+				pstCmdInfo->dRestartEn = 1;
+				DBG_INFO("I2C_M_RD restart dWrDataCnt =%d ", pstCmdInfo->dWrDataCnt);
+			} else {
+				pstCmdInfo->dWrDataCnt = 0;
+			}
+			pstCmdInfo->dRdDataCnt = msgs[i].len;
+			// bounce buffers are allocated with GFP_KERNEL, atomic transfers use PIO
+			if (pstSpI2CInfo->atomic)
+				pstCmdInfo->pRdData = NULL;
+			else
+				pstCmdInfo->pRdData = i2c_get_dma_safe_msg_buf(&msgs[i], 4);
+
+			if ((pstCmdInfo->dRdDataCnt < 4) || (!pstCmdInfo->pRdData)) {
+				pstCmdInfo->pRdData = msgs[i].buf;
+				ret = _sp_i2cm_run(pstSpI2CInfo, sp_i2cm_read);
+			} else {
+				ret = _sp_i2cm_run(pstSpI2CInfo, sp_i2cm_dma_read);
+				i2c_put_dma_safe_msg_buf(pstCmdInfo->pRdData, &msgs[i], true);
+			}
+
+		} else {
+			pstCmdInfo->dRdDataCnt = 0;
+			pstCmdInfo->dWrDataCnt = msgs[i].len;
+			if (pstSpI2CInfo->atomic)
+				pstCmdInfo->pWrData = NULL;
+			else
+				pstCmdInfo->pWrData = i2c_get_dma_safe_msg_buf(&msgs[i], 4);
+
+			if ((pstCmdInfo->dWrDataCnt < 4) || (!pstCmdInfo->pWrData)) {
+				pstCmdInfo->pWrData = msgs[i].buf;
+				ret = _sp_i2cm_run(pstSpI2CInfo, sp_i2cm_write);
+			} else {
+				ret = _sp_i2cm_run(pstSpI2CInfo, sp_i2cm_dma_write);
+				i2c_put_dma_safe_msg_buf(pstCmdInfo->pWrData, &msgs[i], true);
+			}
+		}
+
+		if (ret != I2C_SUCCESS)
+			return -EIO;
+		pstCmdInfo->bFirst = 0;
+	}
+
+	return num;
+}
+
+/*
+ * Power for a transfer. Runtime PM gates the clock once the adapter has
+ * been idle for the autosuspend delay (power/autosuspend_delay_ms). The
+ * reset line stays released, so the registers survive, and every transfer
+ * programs its target's timing from the cached tables anyway: resuming is
+ * just enabling the clock. Atomic transfers cannot wait for a resume, they
+ * enable the clock for themselves and leave the PM state alone.
+ */
+static int _sp_i2cm_pm_get(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct I2C_Stats_t_ *pstStats = &(pstSpI2CInfo->stStats);
+	struct device *dev = pstSpI2CInfo->dev;
+	bool wake = pm_runtime_status_suspended(dev);
+	ktime_t start;
+	s64 ns, max, old;
+	int ret;
+
+	if (pstSpI2CInfo->atomic) {
+		pm_runtime_get_noresume(dev);
+		if (wake) {
+			ret = clk_enable(pstSpI2CInfo->clk);
+			if (ret) {
+				pm_runtime_put_noidle(dev);
+				return ret;
+			}
+			pstSpI2CInfo->atomic_clk = true;
+		}
+		return 0;
+	}
+
+	start = ktime_get();
+	ret = pm_runtime_get_sync(dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(dev);
+		return ret;
+	}
+
+	if (wake) {
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		atomic64_add(ns, &pstStats->pm_wake_ns);
+		// statistics/reset may clear it concurrently
+		max = atomic64_read(&pstStats->pm_wake_max_ns);
+		while (ns > max) {
+			old = atomic64_cmpxchg(&pstStats->pm_wake_max_ns, max, ns);
+			if (old == max)
+				break;
+			max = old;
+		}
+	}
+
+	return 0;
+}
+
+static void _sp_i2cm_pm_put(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	if (pstSpI2CInfo->atomic_clk) {
+		clk_disable(pstSpI2CInfo->clk);
+		pstSpI2CInfo->atomic_clk = false;
+	}
+
+	pm_runtime_mark_last_busy(pstSpI2CInfo->dev);
+	pm_runtime_put_autosuspend(pstSpI2CInfo->dev);
+}
+
+static int sp_master_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = adap->algo_data;
+	int ret;
+
+	ret = _sp_i2cm_pm_get(pstSpI2CInfo);
+	if (ret < 0)
+		return ret;
+
+	ret = _sp_i2cm_master_xfer(pstSpI2CInfo, msgs, num);
+	_sp_i2cm_pm_put(pstSpI2CInfo);
+
+	return ret;
+}
+
+/*
+ * SMBus operations map straight onto one PIO transaction: the command byte
+ * (and any data to write) goes into the data registers, reads use restart
+ * mode. This skips message marshalling and the DMA decision of
+ * sp_master_xfer(). Block reads need the count before the transfer starts,
+ * so they and PEC are left to the emulation in i2c-core.
+ */
+static int _sp_i2cm_smbus_xfer(struct i2c_adapter *adap, u16 addr, unsigned short flags,
+			       char read_write, u8 command, int size,
+			       union i2c_smbus_data *data)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = adap->algo_data;
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+	unsigned char w_data[I2C_SMBUS_BLOCK_MAX + 2];
+	unsigned char r_data[I2C_SMBUS_BLOCK_MAX];
+	unsigned int write_cnt = 1;
+	unsigned int read_cnt = 0;
+	int ret;
+
+	if (flags & (I2C_CLIENT_PEC | I2C_CLIENT_TEN))
+		return -EOPNOTSUPP;
+
+	w_data[0] = command;
+
+	switch (size) {
+	case I2C_SMBUS_BYTE:
+		if (read_write == I2C_SMBUS_READ) {
+			write_cnt = 0;
+			read_cnt = 1;
+		}
+		break;
+
+	case I2C_SMBUS_BYTE_DATA:
+		if (read_write == I2C_SMBUS_READ) {
+			read_cnt = 1;
+		} else {
+			w_data[1] = data->byte;
+			write_cnt = 2;
+		}
+		break;
+
+	case I2C_SMBUS_WORD_DATA:
+		if (read_write == I2C_SMBUS_READ) {
+			read_cnt = 2;
+		} else {
+			w_data[1] = data->word & 0xff;
+			w_data[2] = data->word >> 8;
+			write_cnt = 3;
+		}
+		break;
+
+	case I2C_SMBUS_PROC_CALL:
+		w_data[1] = data->word & 0xff;
+		w_data[2] = data->word >> 8;
+		write_cnt = 3;
+		read_cnt = 2;
+		break;
+
+	case I2C_SMBUS_BLOCK_DATA:
+		if (read_write == I2C_SMBUS_READ)
+			return -EOPNOTSUPP;
+		if (!data->block[0] || (data->block[0] > I2C_SMBUS_BLOCK_MAX))
+			return -EINVAL;
+		memcpy(&w_data[1], data->block, data->block[0] + 1);
+		write_cnt = data->block[0] + 2;
+		break;
+
+	case I2C_SMBUS_I2C_BLOCK_DATA:
+		if (!data->block[0] || (data->block[0] > I2C_SMBUS_BLOCK_MAX))
+			return -EINVAL;
+		if (read_write == I2C_SMBUS_READ) {
+			read_cnt = data->block[0];
+		} else {
+			memcpy(&w_data[1], &data->block[1], data->block[0]);
+			write_cnt = data->block[0] + 1;
+		}
+		break;
+
+	default:
+		return -EOPNOTSUPP;
+	}
+
+	_sp_i2cm_cmd_init(pstSpI2CInfo);
+	_sp_i2cm_cmd_target(pstSpI2CInfo, addr);
+	pstCmdInfo->dWrDataCnt = write_cnt;
+	pstCmdInfo->pWrData = w_data;
+
+	if (read_cnt) {
+		// restart mode writes at most the 32 byte FIFO, all of the above fit
+		pstCmdInfo->dRestartEn = write_cnt ? 1 : 0;
+		pstCmdInfo->dRdDataCnt = read_cnt;
+		pstCmdInfo->pRdData = r_data;
+		ret = _sp_i2cm_run(pstSpI2CInfo, sp_i2cm_read);
+	} else {
+		ret = _sp_i2cm_run(pstSpI2CInfo, sp_i2cm_write);
+	}
+
+	if (ret != I2C_SUCCESS)
+		return -EIO;
+
+	if (read_write == I2C_SMBUS_WRITE && size != I2C_SMBUS_PROC_CALL)
+		return 0;
+
+	switch (size) {
+	case I2C_SMBUS_BYTE:
+	case I2C_SMBUS_BYTE_DATA:
+		data->byte = r_data[0];
+		break;
+	case I2C_SMBUS_WORD_DATA:
+	case I2C_SMBUS_PROC_CALL:
+		data->word = r_data[0] | (r_data[1] << 8);
+		break;
+	case I2C_SMBUS_I2C_BLOCK_DATA:
+		memcpy(&data->block[1], r_data, read_cnt);
+		break;
+	}
+
+	return 0;
+}
+
+static int sp_smbus_xfer(struct i2c_adapter *adap, u16 addr, unsigned short flags,
+			 char read_write, u8 command, int size, union i2c_smbus_data *data)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = adap->algo_data;
+	int ret;
+
+	ret = _sp_i2cm_pm_get(pstSpI2CInfo);
+	if (ret < 0)
+		return ret;
+
+	ret = _sp_i2cm_smbus_xfer(adap, addr, flags, read_write, command, size, data);
+	_sp_i2cm_pm_put(pstSpI2CInfo);
+
+	return ret;
+}
+
+/*
+ * For contexts that cannot sleep or take interrupts, e.g. PMIC access at
+ * shutdown. Every transaction is PIO and polled.
+ */
+static int sp_master_xfer_atomic(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = adap->algo_data;
+	int ret;
+
+	pstSpI2CInfo->atomic = true;
+	ret = sp_master_xfer(adap, msgs, num);
+	pstSpI2CInfo->atomic = false;
+
+	return ret;
+}
+
+static u32 sp_functionality(struct i2c_adapter *adap)
+{
+	u32 func = I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+#if IS_ENABLED(CONFIG_I2C_SLAVE)
+	struct SpI2C_If_t_ *pstSpI2CInfo = adap->algo_data;
+
+	if (pstSpI2CInfo->i2c_slave_regs)
+		func |= I2C_FUNC_SLAVE;
+#endif
+	return func;
+}
+
+#if IS_ENABLED(CONFIG_I2C_SLAVE)
+/* Program the slave block for priv->slave, at registration and after a system resume */
+static void _sp_i2cs_slave_start(struct SpI2C_If_t_ *priv)
+{
+	struct regs_i2cs_s *sr = (struct regs_i2cs_s *)priv->i2c_slave_regs;
+
+	sp_i2cs_addr_set(sr, priv->slave->addr);
+	dev_dbg(priv->dev, "slave addr 0x%x, control at %p\n", priv->slave->addr, &sr->control);
+
+	/* send pin info to IOP*/
+	sp_writel(0x0D0C, &sr->temp);
+	sp_i2cs_enable_slave(sr);
+	sp_writel(0, &sr->status);
+}
+
+static int sp_reg_slave(struct i2c_client *slave)
+{
+	struct SpI2C_If_t_ *priv = i2c_get_adapdata(slave->adapter);
+	int ret;
+	
+	if (!priv->i2c_slave_regs)
+		return -EOPNOTSUPP;
+	if (priv->slave)
+		return -EBUSY;
+	if (slave->flags & I2C_CLIENT_TEN)
+		return -EAFNOSUPPORT;
+	
+	/* Keep device active for slave address detection logic */
+	ret = pm_runtime_get_sync(priv->dev);
+	if (ret < 0) {
+		pm_runtime_put_noidle(priv->dev);
+		return ret;
+	}
+
+	priv->slave = slave;
+	_sp_i2cs_slave_start(priv);
+
+	return 0;
+}
+
+static int sp_unreg_slave(struct i2c_client *slave)
+{
+	struct SpI2C_If_t_ *priv = i2c_get_adapdata(slave->adapter);
+	struct regs_i2cs_s *sr = (struct regs_i2cs_s *)priv->i2c_slave_regs;
+
+	WARN_ON(!priv->slave);
+
+	/* ensure no irq is running before clearing ptr */
+	disable_irq(priv->irq_slave);
+	sp_writel(0, &sr->interrupt);
+	sp_writel(0, &sr->status);
+	enable_irq(priv->irq_slave);
+	//rcar_i2c_write(priv, ICSCR, SDBS);
+	sp_i2cs_addr_set(sr, 0);
+	//sp_i2cs_disable_slave(sr);
+	priv->slave = NULL;
+
+	pm_runtime_mark_last_busy(priv->dev);
+	pm_runtime_put_autosuspend(priv->dev);
+	return 0;
+}
+
+/*
+ * Loopback self-test: an internal slave backend on the controller's own
+ * slave block stores what the master writes and returns it on the next
+ * read, so integrity and round trip latency can be measured without a peer.
+ * Every write stores from the start of the buffer and every read returns
+ * from the start, so each read gives back the write just before it.
+ */
+static int sp_i2cs_selftest_slave_cb(struct i2c_client *client,
+				     enum i2c_slave_event event, u8 *val)
+{
+	struct sp_i2cs_selftest *st = i2c_get_clientdata(client);
+
+	switch (event) {
+	case I2C_SLAVE_WRITE_REQUESTED:
+		st->wr_idx = 0;
+		break;
+
+	case I2C_SLAVE_WRITE_RECEIVED:
+		st->mem[st->wr_idx++ % I2C_SELFTEST_BUF_SIZE] = *val;
+		break;
+
+	case I2C_SLAVE_READ_REQUESTED:
+		st->rd_idx = 0;
+		break;
+
+	case I2C_SLAVE_READ_PROCESSED:
+		*val = st->mem[st->rd_idx++ % I2C_SELFTEST_BUF_SIZE];
+		break;
+
+	case I2C_SLAVE_STOP:
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int sp_i2cs_selftest_run(struct SpI2C_If_t_ *pstSpI2CInfo, unsigned int len,
+				unsigned int iterations)
+{
+	struct sp_i2cs_selftest *st = pstSpI2CInfo->selftest;
+	struct i2c_board_info info = {
+		I2C_BOARD_INFO("sp7021-i2cs-selftest", I2C_SELFTEST_ADDR),
+		.flags = I2C_CLIENT_SLAVE,
+	};
+	struct i2c_msg msgs[2];
+	u8 *w_data, *r_data;
+	u64 *lat;
+	ktime_t start, t;
+	unsigned int i, j;
+	int ret;
+
+	w_data = kmalloc(len, GFP_KERNEL);
+	r_data = kmalloc(len, GFP_KERNEL);
+	lat = vmalloc(array_size(iterations, sizeof(*lat)));
+	if (!w_data || !r_data || !lat) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	// a real client, so the core checks the slave address is free
+	st->client = i2c_new_client_device(&pstSpI2CInfo->adap, &info);
+	if (IS_ERR(st->client)) {
+		ret = PTR_ERR(st->client);
+		st->client = NULL;
+		goto out_free;
+	}
+	i2c_set_clientdata(st->client, st);
+	ret = i2c_slave_register(st->client, sp_i2cs_selftest_slave_cb);
+	if (ret)
+		goto out_unregister;
+
+	msgs[0].addr = I2C_SELFTEST_ADDR;
+	msgs[0].flags = 0;
+	msgs[0].len = len;
+	msgs[0].buf = w_data;
+	msgs[1].addr = I2C_SELFTEST_ADDR;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = len;
+	msgs[1].buf = r_data;
+
+	st->len = len;
+	st->iterations = iterations;
+	st->mismatches = 0;
+	st->min_ns = st->p50_ns = st->p99_ns = st->max_ns = 0;
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		if (fatal_signal_pending(current)) {
+			ret = -EINTR;
+			break;
+		}
+
+		/* a fresh pattern every round, so stale data cannot pass */
+		for (j = 0; j < len; j++)
+			w_data[j] = (i * 131) + (j * 7);
+		memset(r_data, ~w_data[0], len);
+
+		t = ktime_get();
+		ret = i2c_transfer(&pstSpI2CInfo->adap, msgs, ARRAY_SIZE(msgs));
+		lat[i] = ktime_to_ns(ktime_sub(ktime_get(), t));
+		if (ret != ARRAY_SIZE(msgs)) {
+			ret = ret < 0 ? ret : -EIO;
+			break;
+		}
+		ret = 0;
+
+		if (memcmp(w_data, r_data, len))
+			st->mismatches++;
+	}
+	st->elapsed_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	st->done = i;
+	st->status = ret;
+
+	i2c_slave_unregister(st->client);
+
+	if (st->done) {
+		i2c_bench_sort(lat, st->done);
+		st->min_ns = lat[0];
+		st->p50_ns = i2c_bench_pct(lat, st->done, 500);
+		st->p99_ns = i2c_bench_pct(lat, st->done, 990);
+		st->max_ns = lat[st->done - 1];
+	}
+
+out_unregister:
+	i2c_unregister_device(st->client);
+	st->client = NULL;
+out_free:
+	vfree(lat);
+	kfree(r_data);
+	kfree(w_data);
+
+	return ret;
+}
+
+static int sp_i2cs_selftest_show(struct seq_file *s, void *unused)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = s->private;
+	struct sp_i2cs_selftest *st = pstSpI2CInfo->selftest;
+
+	mutex_lock(&st->lock);
+	if (!st->iterations) {
+		seq_puts(s, "no run yet, write \"<len> <iterations>\" to start one\n");
+		goto out;
+	}
+
+	seq_printf(s, "len:          %u\n", st->len);
+	seq_printf(s, "iterations:   %u/%u\n", st->done, st->iterations);
+	seq_printf(s, "status:       %d\n", st->status);
+	seq_printf(s, "mismatches:   %u\n", st->mismatches);
+	seq_printf(s, "elapsed:      %llu us\n", div_u64(st->elapsed_ns, NSEC_PER_USEC));
+	if (st->elapsed_ns)
+		seq_printf(s, "throughput:   %llu B/s\n",
+			   div64_u64(2ULL * st->len * st->done * NSEC_PER_SEC, st->elapsed_ns));
+	seq_printf(s, "latency min:  %llu ns\n", st->min_ns);
+	seq_printf(s, "latency p50:  %llu ns\n", st->p50_ns);
+	seq_printf(s, "latency p99:  %llu ns\n", st->p99_ns);
+	seq_printf(s, "latency max:  %llu ns\n", st->max_ns);
+
+out:
+	mutex_unlock(&st->lock);
+	return 0;
+}
+
+static int sp_i2cs_selftest_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sp_i2cs_selftest_show, inode->i_private);
+}
+
+static ssize_t sp_i2cs_selftest_write(struct file *file, const char __user *ubuf,
+				      size_t count, loff_t *ppos)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = file_inode(file)->i_private;
+	struct sp_i2cs_selftest *st = pstSpI2CInfo->selftest;
+	unsigned int len, iterations;
+	char buf[32];
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u", &len, &iterations) != 2)
+		return -EINVAL;
+	if (!len || len > I2C_SELFTEST_MAX_LEN ||
+	    !iterations || iterations > I2C_SELFTEST_MAX_ITER)
+		return -ERANGE;
+
+	mutex_lock(&st->lock);
+	ret = sp_i2cs_selftest_run(pstSpI2CInfo, len, iterations);
+	mutex_unlock(&st->lock);
+
+	/* a failed round is reported through the file, not the write */
+	if (ret == -EBUSY || ret == -ENOMEM || ret == -EOPNOTSUPP)
+		return ret;
+
+	return count;
+}
+
+static const struct file_operations sp_i2cs_selftest_fops = {
+	.owner = THIS_MODULE,
+	.open = sp_i2cs_selftest_open,
+	.read = seq_read,
+	.write = sp_i2cs_selftest_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
+#ifdef CONFIG_I2C_SUNPLUS_MODEL
+/*
+ * Burst read length sweep on the software model: a pattern is written to
+ * the model's target once, then read back through the PIO path for every
+ * length from first to last, with 4 and with 16 byte bursts (the two
+ * I2C_IS_READ16BYTE settings), and compared byte for byte. The model's
+ * counters give the register accesses and interrupts per byte of each.
+ *
+ * The PIO path is called directly, i2c_transfer() would take DMA for all
+ * but the shortest reads. Bus time is the model's (byte_ns), 1..65535 moves
+ * 2^31 bytes per burst size, use a step or a short byte_ns for quick runs.
+ * Other users of the modelled bus overwrite the pattern, keep it idle.
+ */
+static const unsigned int sp_i2cm_sweep_bursts[] = { 4, 16 };
+
+static int sp_i2cm_sweep_read(struct SpI2C_If_t_ *pstSpI2CInfo, unsigned int burst_bytes,
+			      u8 *buf, unsigned int len)
+{
+	struct I2C_Cmd_t_ *pstCmdInfo = &(pstSpI2CInfo->stCmdInfo);
+	unsigned int saved;
+	int ret, xret;
+
+	i2c_lock_bus(&pstSpI2CInfo->adap, I2C_LOCK_ROOT_ADAPTER);
+	ret = _sp_i2cm_pm_get(pstSpI2CInfo);
+	if (ret == 0) {
+		saved = pstSpI2CInfo->dBurstBytes;
+		pstSpI2CInfo->dBurstBytes = burst_bytes;
+
+		_sp_i2cm_cmd_init(pstSpI2CInfo);
+		_sp_i2cm_cmd_target(pstSpI2CInfo, I2C_SWEEP_ADDR);
+		pstCmdInfo->dRdDataCnt = len;
+		pstCmdInfo->pRdData = buf;
+		// no retries, a failure has to show
+		xret = sp_i2cm_read(pstCmdInfo, pstSpI2CInfo);
+		_sp_i2cm_stats_xfer(pstSpI2CInfo, sp_i2cm_read, xret);
+		if (xret != I2C_SUCCESS)
+			ret = -EIO;
+
+		pstSpI2CInfo->dBurstBytes = saved;
+		_sp_i2cm_pm_put(pstSpI2CInfo);
+	}
+	i2c_unlock_bus(&pstSpI2CInfo->adap, I2C_LOCK_ROOT_ADAPTER);
+
+	return ret;
+}
+
+static int sp_i2cm_sweep_one(struct SpI2C_If_t_ *pstSpI2CInfo, struct sp_i2cm_sweep_run *run,
+			     const u8 *pattern, u8 *r_data)
+{
+	struct sp_i2cm_sweep *sw = pstSpI2CInfo->sweep;
+	struct i2c_msg msg = {
+		.addr = I2C_SWEEP_ADDR,
+		.flags = 0,
+		.len = sw->last,
+		.buf = (u8 *)pattern,
+	};
+	unsigned int len, i;
+	int ret;
+
+	ret = i2c_transfer(&pstSpI2CInfo->adap, &msg, 1);
+	if (ret != 1)
+		return ret < 0 ? ret : -EIO;
+
+	// count the reads only
+	ret = sp_i2cm_model_counters(pstSpI2CInfo->i2c_regs, &run->cnt, true);
+	if (ret)
+		return ret;
+
+	for (len = sw->first; len <= sw->last; len += sw->step) {
+		if (fatal_signal_pending(current))
+			return -EINTR;
+
+		memset(r_data, ~pattern[0], len);
+		ret = sp_i2cm_sweep_read(pstSpI2CInfo, run->burst_bytes, r_data, len);
+		run->lengths++;
+
+		for (i = 0; (ret == 0) && (i < len); i++) {
+			if (r_data[i] != pattern[i])
+				break;
+		}
+		if ((ret == 0) && (i == len))
+			continue;
+
+		if (!run->failures++) {
+			run->first_bad = len;
+			run->bad_offset = i;
+			run->status = ret;
+		}
+	}
+
+	return sp_i2cm_model_counters(pstSpI2CInfo->i2c_regs, &run->cnt, false);
+}
+
+static int sp_i2cm_sweep_run(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct sp_i2cm_sweep *sw = pstSpI2CInfo->sweep;
+	u8 *pattern, *r_data;
+	unsigned int i;
+	int ret = 0;
+
+	pattern = kmalloc(sw->last, GFP_KERNEL);
+	r_data = kmalloc(sw->last, GFP_KERNEL);
+	if (!pattern || !r_data) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	// no period that divides a burst or the FIFO
+	for (i = 0; i < sw->last; i++)
+		pattern[i] = (i * 7) + (i >> 8) + 1;
+
+	for (i = 0; i < ARRAY_SIZE(sw->run); i++) {
+		sw->run[i].burst_bytes = sp_i2cm_sweep_bursts[i];
+		ret = sp_i2cm_sweep_one(pstSpI2CInfo, &sw->run[i], pattern, r_data);
+		if (ret) {
+			sw->run[i].status = ret;
+			break;
+		}
+	}
+
+out_free:
+	kfree(r_data);
+	kfree(pattern);
+
+	return ret;
+}
+
+static int sp_i2cm_sweep_show(struct seq_file *s, void *unused)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = s->private;
+	struct sp_i2cm_sweep *sw = pstSpI2CInfo->sweep;
+	struct sp_i2cm_sweep_run *run;
+	unsigned int i;
+
+	mutex_lock(&sw->lock);
+	if (!sw->last) {
+		seq_puts(s, "no run yet, write \"<first> <last> [<step>]\" to start one\n");
+		goto out;
+	}
+
+	seq_printf(s, "lengths:        %u..%u step %u\n", sw->first, sw->last, sw->step);
+	for (i = 0; i < ARRAY_SIZE(sw->run); i++) {
+		run = &sw->run[i];
+		if (!run->burst_bytes)
+			continue;
+
+		seq_printf(s, "burst %u:\n", run->burst_bytes);
+		seq_printf(s, "  status:       %d\n", run->status);
+		seq_printf(s, "  lengths:      %u\n", run->lengths);
+		seq_printf(s, "  failures:     %u\n", run->failures);
+		if (run->failures)
+			seq_printf(s, "  first bad:    len %u offset %u\n",
+				   run->first_bad, run->bad_offset);
+		seq_printf(s, "  bytes:        %llu\n", run->cnt.bytes);
+		seq_printf(s, "  reg reads:    %llu\n", run->cnt.reads);
+		seq_printf(s, "  reg writes:   %llu\n", run->cnt.writes);
+		seq_printf(s, "  interrupts:   %llu\n", run->cnt.irqs);
+		if (run->cnt.bytes) {
+			/* in thousandths, like the model's own file */
+			seq_printf(s, "  mmio per byte: %llu/1000\n",
+				   div64_u64((run->cnt.reads + run->cnt.writes) * 1000, run->cnt.bytes));
+			seq_printf(s, "  irqs per byte: %llu/1000\n",
+				   div64_u64(run->cnt.irqs * 1000, run->cnt.bytes));
+		}
+	}
+
+out:
+	mutex_unlock(&sw->lock);
+	return 0;
+}
+
+static int sp_i2cm_sweep_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sp_i2cm_sweep_show, inode->i_private);
+}
+
+static ssize_t sp_i2cm_sweep_write(struct file *file, const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = file_inode(file)->i_private;
+	struct sp_i2cm_sweep *sw = pstSpI2CInfo->sweep;
+	unsigned int first, last, step = 1;
+	char buf[32];
+	int ret;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %u %u", &first, &last, &step) < 2)
+		return -EINVAL;
+	if (!first || first > last || last > I2C_SWEEP_MAX_LEN || !step)
+		return -ERANGE;
+
+	mutex_lock(&sw->lock);
+	memset(sw->run, 0, sizeof(sw->run));
+	sw->first = first;
+	sw->last = last;
+	sw->step = step;
+	ret = sp_i2cm_sweep_run(pstSpI2CInfo);
+	mutex_unlock(&sw->lock);
+
+	/* mismatches are reported through the file, not the write */
+	if (ret == -ENOMEM || ret == -ENODEV || ret == -EINTR)
+		return ret;
+
+	return count;
+}
+
+static const struct file_operations sp_i2cm_sweep_fops = {
+	.owner = THIS_MODULE,
+	.open = sp_i2cm_sweep_open,
+	.read = seq_read,
+	.write = sp_i2cm_sweep_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+#endif
+
+/*
+ * statistics/ of the controller device, counting since probe or the last
+ * write to "reset". A transfer and its error class count once, with the
+ * result after retries; retries, resets and bus_time count every attempt.
+ */
+#define SP_I2C_STATS_ATTR(_name)						\
+static ssize_t _name##_show(struct device *dev,					\
+			    struct device_attribute *attr, char *buf)		\
+{										\
+	struct SpI2C_If_t_ *pstSpI2CInfo = dev_get_drvdata(dev);		\
+										\
+	return sprintf(buf, "%lld\n", atomic64_read(&pstSpI2CInfo->stStats._name)); \
+}										\
+static DEVICE_ATTR_RO(_name)
+
+SP_I2C_STATS_ATTR(transfers);
+SP_I2C_STATS_ATTR(bytes);
+SP_I2C_STATS_ATTR(pio);
+SP_I2C_STATS_ATTR(dma);
+SP_I2C_STATS_ATTR(restarts);
+SP_I2C_STATS_ATTR(addr_nacks);
+SP_I2C_STATS_ATTR(data_nacks);
+SP_I2C_STATS_ATTR(scl_hold);
+SP_I2C_STATS_ATTR(fifo_empty);
+SP_I2C_STATS_ATTR(overflows);
+SP_I2C_STATS_ATTR(timeouts);
+SP_I2C_STATS_ATTR(resets);
+SP_I2C_STATS_ATTR(retries);
+SP_I2C_STATS_ATTR(recoveries);
+SP_I2C_STATS_ATTR(pm_suspends);
+SP_I2C_STATS_ATTR(pm_resumes);
+SP_I2C_STATS_ATTR(pm_gated_us);
+SP_I2C_STATS_ATTR(pm_wake_ns);
+SP_I2C_STATS_ATTR(pm_wake_max_ns);
+
+static ssize_t bus_time_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = dev_get_drvdata(dev);
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < I2C_STATS_HIST_BUCKETS; i++) {
+		if (i == I2C_STATS_HIST_BUCKETS - 1)
+			len += sprintf(buf + len, "%lu+ us: ", BIT(i));
+		else
+			len += sprintf(buf + len, "%lu-%lu us: ", i ? BIT(i) : 0, BIT(i + 1) - 1);
+		len += sprintf(buf + len, "%lld\n", atomic64_read(&pstSpI2CInfo->stStats.bus_time[i]));
+	}
+
+	return len;
+}
+static DEVICE_ATTR_RO(bus_time);
+
+static ssize_t reset_store(struct device *dev, struct device_attribute *attr,
+			   const char *buf, size_t count)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = dev_get_drvdata(dev);
+	struct I2C_Stats_t_ *pstStats = &(pstSpI2CInfo->stStats);
+	int i;
+
+	atomic64_set(&pstStats->transfers, 0);
+	atomic64_set(&pstStats->bytes, 0);
+	atomic64_set(&pstStats->pio, 0);
+	atomic64_set(&pstStats->dma, 0);
+	atomic64_set(&pstStats->restarts, 0);
+	atomic64_set(&pstStats->addr_nacks, 0);
+	atomic64_set(&pstStats->data_nacks, 0);
+	atomic64_set(&pstStats->scl_hold, 0);
+	atomic64_set(&pstStats->fifo_empty, 0);
+	atomic64_set(&pstStats->overflows, 0);
+	atomic64_set(&pstStats->timeouts, 0);
+	atomic64_set(&pstStats->resets, 0);
+	atomic64_set(&pstStats->retries, 0);
+	atomic64_set(&pstStats->recoveries, 0);
+	atomic64_set(&pstStats->pm_suspends, 0);
+	atomic64_set(&pstStats->pm_resumes, 0);
+	atomic64_set(&pstStats->pm_gated_us, 0);
+	atomic64_set(&pstStats->pm_wake_ns, 0);
+	atomic64_set(&pstStats->pm_wake_max_ns, 0);
+	for (i = 0; i < I2C_STATS_HIST_BUCKETS; i++)
+		atomic64_set(&pstStats->bus_time[i], 0);
+
+	return count;
+}
+static DEVICE_ATTR_WO(reset);
+
+static struct attribute *sp_i2c_stats_attrs[] = {
+	&dev_attr_transfers.attr,
+	&dev_attr_bytes.attr,
+	&dev_attr_pio.attr,
+	&dev_attr_dma.attr,
+	&dev_attr_restarts.attr,
+	&dev_attr_addr_nacks.attr,
+	&dev_attr_data_nacks.attr,
+	&dev_attr_scl_hold.attr,
+	&dev_attr_fifo_empty.attr,
+	&dev_attr_overflows.attr,
+	&dev_attr_timeouts.attr,
+	&dev_attr_resets.attr,
+	&dev_attr_retries.attr,
+	&dev_attr_recoveries.attr,
+	&dev_attr_pm_suspends.attr,
+	&dev_attr_pm_resumes.attr,
+	&dev_attr_pm_gated_us.attr,
+	&dev_attr_pm_wake_ns.attr,
+	&dev_attr_pm_wake_max_ns.attr,
+	&dev_attr_bus_time.attr,
+	&dev_attr_reset.attr,
+	NULL,
+};
+
+static const struct attribute_group sp_i2c_stats_group = {
+	.name = "statistics",
+	.attrs = sp_i2c_stats_attrs,
+};
+
+static const struct attribute_group *sp_i2c_groups[] = {
+	&sp_i2c_stats_group,
+	NULL,
+};
+
+static const struct i2c_algorithm sp_algorithm = {
+	.master_xfer	= sp_master_xfer,
+	.master_xfer_atomic = sp_master_xfer_atomic,
+	.smbus_xfer	= sp_smbus_xfer,
+	.functionality	= sp_functionality,
+#if IS_ENABLED(CONFIG_I2C_SLAVE)
+	.reg_slave = sp_reg_slave,
+	.unreg_slave = sp_unreg_slave,
+#endif
+};
+
+/*
+ * Asynchronous queue. The block has a single register set, so the next
+ * transfer cannot be programmed while one is on the bus. What the queue
+ * saves is everything around it: submitters do not sleep, and the worker
+ * runs queued transfers back to back under one bus lock, I2C_ASYNC_BATCH at
+ * a time so synchronous users are not starved.
+ */
+static void sp_i2c_async_release(struct kref *ref)
+{
+	kfree(container_of(ref, struct sp_i2c_async, ref));
+}
+
+static void sp_i2c_async_work(struct work_struct *work)
+{
+	struct sp_i2c_async *async = container_of(work, struct sp_i2c_async, work);
+	struct sp_i2c_async_xfer *xfer[I2C_ASYNC_BATCH];
+	int ret[I2C_ASYNC_BATCH];
+	unsigned int done, i;
+
+	i2c_lock_bus(async->adap, I2C_LOCK_SEGMENT);
+	for (done = 0; done < I2C_ASYNC_BATCH; done++) {
+		spin_lock_irq(&async->lock);
+		xfer[done] = list_first_entry_or_null(&async->queue, struct sp_i2c_async_xfer, node);
+		if (xfer[done])
+			list_del(&xfer[done]->node);
+		spin_unlock_irq(&async->lock);
+		if (!xfer[done])
+			break;
+
+		ret[done] = __i2c_transfer(async->adap, xfer[done]->msgs, xfer[done]->num);
+	}
+	i2c_unlock_bus(async->adap, I2C_LOCK_SEGMENT);
+
+	// completions may take the bus themselves
+	for (i = 0; i < done; i++)
+		xfer[i]->complete(xfer[i], ret[i]);
+
+	spin_lock_irq(&async->lock);
+	if (!list_empty(&async->queue) && !async->dead)
+		queue_work(system_unbound_wq, &async->work);
+	spin_unlock_irq(&async->lock);
+}
+
+int sp_i2c_async_submit(struct i2c_adapter *adap, struct sp_i2c_async_xfer *xfer)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo;
+	struct sp_i2c_async *async;
+	unsigned long flags;
+	int ret = 0;
+
+	if (adap->algo != &sp_algorithm)
+		return -EINVAL;
+	if (!xfer->num || !xfer->complete)
+		return -EINVAL;
+
+	pstSpI2CInfo = adap->algo_data;
+	async = pstSpI2CInfo->async;
+	if (!async)
+		return -ENODEV;
+
+	spin_lock_irqsave(&async->lock, flags);
+	if (async->dead) {
+		ret = -ESHUTDOWN;
+	} else {
+		list_add_tail(&xfer->node, &async->queue);
+		queue_work(system_unbound_wq, &async->work);
+	}
+	spin_unlock_irqrestore(&async->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sp_i2c_async_submit);
+
+int sp_i2c_set_target_speed(struct i2c_adapter *adap, u16 addr, u32 bus_freq_hz)
+{
+	int ret;
+
+	if (adap->algo != &sp_algorithm)
+		return -EINVAL;
+
+	i2c_lock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+	ret = _sp_i2cm_target_speed_set(adap->algo_data, addr, bus_freq_hz);
+	i2c_unlock_bus(adap, I2C_LOCK_ROOT_ADAPTER);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sp_i2c_set_target_speed);
+
+/*
+ * Fan-out over several controllers. Every entry goes to the async queue of
+ * its adapter, whose worker runs it under that adapter's own bus lock, so
+ * the controllers work in parallel and nothing is shared between them but
+ * the countdown of this batch.
+ */
+struct sp_i2c_stripe {
+	atomic_t pending;
+	struct completion done;
+};
+
+static void sp_i2c_stripe_complete(struct sp_i2c_async_xfer *xfer, int ret)
+{
+	struct sp_i2c_stripe_xfer *sx = container_of(xfer, struct sp_i2c_stripe_xfer, async);
+	struct sp_i2c_stripe *stripe = xfer->context;
+
+	sx->ret = ret;
+	if (atomic_dec_and_test(&stripe->pending))
+		complete(&stripe->done);
+}
+
+int sp_i2c_stripe_run(struct sp_i2c_stripe_xfer *xfers, int n)
+{
+	struct sp_i2c_stripe stripe;
+	int ret = 0;
+	int i, err;
+
+	if (n <= 0)
+		return -EINVAL;
+
+	// one extra count, so the batch cannot finish while still being queued
+	atomic_set(&stripe.pending, n + 1);
+	init_completion(&stripe.done);
+
+	for (i = 0; i < n; i++) {
+		xfers[i].async.msgs = xfers[i].msgs;
+		xfers[i].async.num = xfers[i].num;
+		xfers[i].async.complete = sp_i2c_stripe_complete;
+		xfers[i].async.context = &stripe;
+
+		err = sp_i2c_async_submit(xfers[i].adap, &xfers[i].async);
+		if (err) {
+			xfers[i].ret = err;
+			atomic_dec(&stripe.pending);
+		}
+	}
+
+	// the entries live in the caller's memory, wait for all of them
+	if (!atomic_dec_and_test(&stripe.pending))
+		wait_for_completion(&stripe.done);
+
+	for (i = 0; i < n; i++) {
+		if (xfers[i].ret == xfers[i].num)
+			continue;
+		if (!ret)
+			ret = (xfers[i].ret < 0) ? xfers[i].ret : -EIO;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sp_i2c_stripe_run);
+
+/* debugfs view of the per target timing, targets that answered or have a speed set */
+static int sp_i2c_targets_show(struct seq_file *s, void *unused)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = s->private;
+	struct I2C_Target_t_ *pstTarget;
+	int i;
+
+	seq_puts(s, "addr max-kHz   kHz delay sda-half     xfers    errors backoffs advances holdoff\n");
+	for (i = 0; i < I2C_TARGET_NUM; i++) {
+		pstTarget = &pstSpI2CInfo->stTarget[i];
+		if (!pstTarget->bSeen && (pstTarget->bCeiling == I2C_SPEED_BUS))
+			continue;
+
+		seq_printf(s, "0x%02x %7u %5u %5u %8s %9u %9u %8u %8u %7u\n", i,
+			   pstSpI2CInfo->stTiming[pstTarget->bCeiling].dFreq,
+			   pstTarget->stTiming.dFreq, pstTarget->bDelay,
+			   (pstTarget->stTiming.dCtl2 & I2C_CTL2_SDA_HALF_ENABLE) ? "yes" : "no",
+			   pstTarget->dXfers, pstTarget->dErrors, pstTarget->dBackoffs,
+			   pstTarget->dAdvances, pstTarget->dHoldOff);
+	}
+
+	return 0;
+}
+
+static int sp_i2c_targets_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sp_i2c_targets_show, inode->i_private);
+}
+
+/* "<addr> <bus_freq_hz>" sets the speed of a target, "reset" restarts them all */
+static ssize_t sp_i2c_targets_write(struct file *file, const char __user *ubuf,
+				    size_t count, loff_t *ppos)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = file_inode(file)->i_private;
+	struct I2C_Target_t_ *pstTarget;
+	unsigned int bus_freq;
+	char buf[32];
+	int ret = 0;
+	int addr, i;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	if (sysfs_streq(buf, "reset")) {
+		i2c_lock_bus(&pstSpI2CInfo->adap, I2C_LOCK_ROOT_ADAPTER);
+		for (i = 0; i < I2C_TARGET_NUM; i++) {
+			pstTarget = &pstSpI2CInfo->stTarget[i];
+			_sp_i2cm_target_reset(pstSpI2CInfo, pstTarget, pstTarget->bCeiling);
+		}
+		i2c_unlock_bus(&pstSpI2CInfo->adap, I2C_LOCK_ROOT_ADAPTER);
+	} else if (sscanf(buf, "%i %u", &addr, &bus_freq) == 2) {
+		if ((addr < 0) || (addr >= I2C_TARGET_NUM))
+			return -EINVAL;
+		ret = sp_i2c_set_target_speed(&pstSpI2CInfo->adap, addr, bus_freq);
+	} else {
+		ret = -EINVAL;
+	}
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations sp_i2c_targets_fops = {
+	.owner = THIS_MODULE,
+	.open = sp_i2c_targets_open,
+	.read = seq_read,
+	.write = sp_i2c_targets_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* Character device front end, one context per open file */
+struct sp_i2c_async_file {
+	struct sp_i2c_async *async;
+	spinlock_t lock;
+	struct list_head done;
+	unsigned int inflight;
+	wait_queue_head_t wait;
+};
 
-			restart_write_cnt = msgs[i].len;
-			for (i = 0; i < restart_write_cnt; i++)
-				restart_w_data[i] = msgs[i].buf[i];
+struct sp_i2c_async_cmd {
+	struct sp_i2c_async_xfer xfer;
+	struct sp_i2c_async_file *file;
+	struct list_head node;
+	struct i2c_msg msgs[2];
+	u64 tag;
+	int status;
+	u16 rd_len;
+	u8 *rd_buf;
+	u8 buf[];
+};
 
-			restart_en = 1;
-			continue;
-		}
+static void sp_i2c_async_cmd_done(struct sp_i2c_async_xfer *xfer, int ret)
+{
+	struct sp_i2c_async_cmd *cmd = container_of(xfer, struct sp_i2c_async_cmd, xfer);
+	struct sp_i2c_async_file *file = cmd->file;
+	unsigned long flags;
 
-		if (msgs[i].flags & I2C_M_RD) {
-			if (restart_en == 1) {
-				pstCmdInfo->dWrDataCnt = restart_write_cnt;
-				pstCmdInfo->pWrData = restart_w_data;
-				DBG_INFO("I2C_M_RD dWrDataCnt =%d ", pstCmdInfo->dWrDataCnt);
-				DBG_INFO("I2C_M_RD pstCmdInfo->pWrData[0] =%x ", pstCmdInfo->pWrData[0]);
-				DBG_INFO("I2C_M_RD pstCmdInfo->pWrData[1] =%x ", pstCmdInfo->pWrData[1]);
-				restart_en = 0;
-				pstCmdInfo->dRestartEn = 1;
-			}
-			pstCmdInfo->dRdDataCnt = msgs[i].len;
-			pstCmdInfo->pRdData = i2c_get_dma_safe_msg_buf(&msgs[i], 4);
+	cmd->status = ret == xfer->num ? 0 : (ret < 0 ? ret : -EIO);
 
-			if ((pstCmdInfo->dRdDataCnt < 4) || (!pstCmdInfo->pRdData)) {
-				pstCmdInfo->pRdData = msgs[i].buf;
-				ret = sp_i2cm_read(pstCmdInfo, pstSpI2CInfo);
-			} else {
-				ret = sp_i2cm_dma_read(pstCmdInfo, pstSpI2CInfo);
-				i2c_put_dma_safe_msg_buf(pstCmdInfo->pRdData, &msgs[i], true);
-			}
+	spin_lock_irqsave(&file->lock, flags);
+	list_add_tail(&cmd->node, &file->done);
+	file->inflight--;
+	spin_unlock_irqrestore(&file->lock, flags);
 
-		} else {
-			pstCmdInfo->dWrDataCnt = msgs[i].len;
-			pstCmdInfo->pWrData = i2c_get_dma_safe_msg_buf(&msgs[i], 4);
-				if ((pstCmdInfo->dWrDataCnt < 4) || (!pstCmdInfo->pWrData)) {
-					pstCmdInfo->pWrData = msgs[i].buf;
-					ret = sp_i2cm_write(pstCmdInfo, pstSpI2CInfo);
-				} else {
-					ret = sp_i2cm_dma_write(pstCmdInfo, pstSpI2CInfo);
-					i2c_put_dma_safe_msg_buf(pstCmdInfo->pWrData, &msgs[i], true);
-				}
-		}
+	wake_up_poll(&file->wait, EPOLLIN | EPOLLOUT);
+}
 
-		if (ret != I2C_SUCCESS)
-			return -EIO;
+static int sp_i2c_async_open(struct inode *inode, struct file *filp)
+{
+	struct sp_i2c_async *async = container_of(filp->private_data, struct sp_i2c_async, misc);
+	struct sp_i2c_async_file *file;
+
+	file = kzalloc(sizeof(*file), GFP_KERNEL);
+	if (!file)
+		return -ENOMEM;
+
+	spin_lock_init(&file->lock);
+	INIT_LIST_HEAD(&file->done);
+	init_waitqueue_head(&file->wait);
+	file->async = async;
+	kref_get(&async->ref);
+	filp->private_data = file;
+
+	return stream_open(inode, filp);
+}
+
+static int sp_i2c_async_release_file(struct inode *inode, struct file *filp)
+{
+	struct sp_i2c_async_file *file = filp->private_data;
+	struct sp_i2c_async_cmd *cmd, *tmp;
+
+	/* transfers time out, so this wait is bounded */
+	wait_event(file->wait, !READ_ONCE(file->inflight));
+
+	list_for_each_entry_safe(cmd, tmp, &file->done, node)
+		kfree(cmd);
+	kref_put(&file->async->ref, sp_i2c_async_release);
+	kfree(file);
+
+	return 0;
+}
+
+static ssize_t sp_i2c_async_write(struct file *filp, const char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	struct sp_i2c_async_file *file = filp->private_data;
+	struct sp_i2c_async *async = file->async;
+	struct sp_i2c_async_req req;
+	struct sp_i2c_async_cmd *cmd;
+	int n = 0;
+	int ret;
+
+	if (count < sizeof(req))
+		return -EINVAL;
+	if (copy_from_user(&req, ubuf, sizeof(req)))
+		return -EFAULT;
+	if ((req.addr > 0x7f) || req.reserved || (!req.wr_len && !req.rd_len) ||
+	    (req.wr_len > I2C_ASYNC_MAX_LEN) || (req.rd_len > I2C_ASYNC_MAX_LEN) ||
+	    (count != sizeof(req) + req.wr_len))
+		return -EINVAL;
+
+	cmd = kzalloc(sizeof(*cmd) + req.wr_len + req.rd_len, GFP_KERNEL);
+	if (!cmd)
+		return -ENOMEM;
+	if (copy_from_user(cmd->buf, ubuf + sizeof(req), req.wr_len)) {
+		kfree(cmd);
+		return -EFAULT;
 	}
 
-#ifdef CONFIG_PM_RUNTIME_I2C
-	   pm_runtime_put(&adap->dev);
+	if (req.wr_len) {
+		cmd->msgs[n].addr = req.addr;
+		cmd->msgs[n].len = req.wr_len;
+		cmd->msgs[n].buf = cmd->buf;
+		n++;
+	}
+	if (req.rd_len) {
+		cmd->rd_buf = cmd->buf + req.wr_len;
+		cmd->msgs[n].addr = req.addr;
+		cmd->msgs[n].flags = I2C_M_RD;
+		cmd->msgs[n].len = req.rd_len;
+		cmd->msgs[n].buf = cmd->rd_buf;
+		n++;
+	}
+	cmd->file = file;
+	cmd->tag = req.tag;
+	cmd->rd_len = req.rd_len;
+	cmd->xfer.msgs = cmd->msgs;
+	cmd->xfer.num = n;
+	cmd->xfer.complete = sp_i2c_async_cmd_done;
+
+	/* reserve a slot, waiting for one unless non-blocking */
+	for (;;) {
+		spin_lock_irq(&file->lock);
+		if (file->inflight < I2C_ASYNC_DEPTH) {
+			file->inflight++;
+			spin_unlock_irq(&file->lock);
+			break;
+		}
+		spin_unlock_irq(&file->lock);
 
-#endif
+		if (filp->f_flags & O_NONBLOCK) {
+			kfree(cmd);
+			return -EAGAIN;
+		}
+		ret = wait_event_interruptible(file->wait,
+					       READ_ONCE(file->inflight) < I2C_ASYNC_DEPTH);
+		if (ret) {
+			kfree(cmd);
+			return ret;
+		}
+	}
 
-	return num;
+	ret = -ESHUTDOWN;
+	spin_lock_irq(&async->lock);
+	if (!async->dead) {
+		list_add_tail(&cmd->xfer.node, &async->queue);
+		queue_work(system_unbound_wq, &async->work);
+		ret = 0;
+	}
+	spin_unlock_irq(&async->lock);
 
-#ifdef CONFIG_PM_RUNTIME_I2C
-out:
-				pm_runtime_mark_last_busy(&adap->dev);
-				pm_runtime_put_autosuspend(&adap->dev);
-				return num;
-#endif
+	if (ret) {
+		spin_lock_irq(&file->lock);
+		file->inflight--;
+		spin_unlock_irq(&file->lock);
+		kfree(cmd);
+		return ret;
+	}
 
+	return count;
 }
 
-static u32 sp_functionality(struct i2c_adapter *adap)
+static ssize_t sp_i2c_async_read(struct file *filp, char __user *ubuf,
+				 size_t count, loff_t *ppos)
 {
-	u32 func = I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
-#if IS_ENABLED(CONFIG_I2C_SLAVE)
-	func |= I2C_FUNC_SLAVE;
-#endif
-	return func;
+	struct sp_i2c_async_file *file = filp->private_data;
+	struct sp_i2c_async_resp resp = { };
+	struct sp_i2c_async_cmd *cmd;
+	size_t len = 0;
+	int ret;
+
+	for (;;) {
+		spin_lock_irq(&file->lock);
+		cmd = list_first_entry_or_null(&file->done, struct sp_i2c_async_cmd, node);
+		if (cmd) {
+			len = sizeof(resp) + (cmd->status ? 0 : cmd->rd_len);
+			if (count < len) {
+				spin_unlock_irq(&file->lock);
+				return -EMSGSIZE;
+			}
+			list_del(&cmd->node);
+		}
+		spin_unlock_irq(&file->lock);
+		if (cmd)
+			break;
+
+		if (filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(file->wait, !list_empty(&file->done));
+		if (ret)
+			return ret;
+	}
+
+	resp.tag = cmd->tag;
+	resp.status = cmd->status;
+	resp.rd_len = cmd->status ? 0 : cmd->rd_len;
+
+	ret = 0;
+	if (copy_to_user(ubuf, &resp, sizeof(resp)) ||
+	    copy_to_user(ubuf + sizeof(resp), cmd->rd_buf, resp.rd_len))
+		ret = -EFAULT;
+	kfree(cmd);
+
+	return ret ? ret : len;
 }
 
-#if IS_ENABLED(CONFIG_I2C_SLAVE)
-static int sp_reg_slave(struct i2c_client *slave)
+static __poll_t sp_i2c_async_poll(struct file *filp, poll_table *wait)
 {
-	struct SpI2C_If_t_ *priv = i2c_get_adapdata(slave->adapter);
-	struct regs_i2cs_s *sr = (struct regs_i2cs_s *)priv->i2c_slave_regs;
-	
-	if (priv->slave)
-		return -EBUSY;
-	if (slave->flags & I2C_CLIENT_TEN)
-		return -EAFNOSUPPORT;
-	
-#ifdef CONFIG_PM_RUNTIME_I2C
-	/* Keep device active for slave address detection logic */
-	ret = pm_runtime_get_sync(priv->dev);
-	if (ret < 0)
-		goto out;
-#endif
+	struct sp_i2c_async_file *file = filp->private_data;
+	__poll_t mask = 0;
 
-	priv->slave = slave;
-	sp_i2cs_addr_set(sr, slave->addr);
-	printk("slave->addr :       0x%x\n", slave->addr);
-	printk("controlcontrolcontrol :       0x%x\n", &sr->control);
+	poll_wait(filp, &file->wait, wait);
 
-	/* send pin info to IOP*/
-	writel(0x0D0C, &sr->temp);
-	sp_i2cs_enable_slave(sr);
-	writel(0, &sr->status);
+	spin_lock_irq(&file->lock);
+	if (!list_empty(&file->done))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (file->inflight < I2C_ASYNC_DEPTH)
+		mask |= EPOLLOUT | EPOLLWRNORM;
+	spin_unlock_irq(&file->lock);
 
-	return 0;
+	return mask;
+}
 
-#ifdef CONFIG_PM_RUNTIME_I2C
-out:
-	pm_runtime_mark_last_busy(&priv->dev);
-	pm_runtime_put_autosuspend(&priv->dev);
+static const struct file_operations sp_i2c_async_fops = {
+	.owner = THIS_MODULE,
+	.open = sp_i2c_async_open,
+	.release = sp_i2c_async_release_file,
+	.read = sp_i2c_async_read,
+	.write = sp_i2c_async_write,
+	.poll = sp_i2c_async_poll,
+	.llseek = no_llseek,
+};
+
+static int sp_i2c_async_init(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct sp_i2c_async *async;
+	int ret;
+
+	async = kzalloc(sizeof(*async), GFP_KERNEL);
+	if (!async)
+		return -ENOMEM;
+
+	kref_init(&async->ref);
+	spin_lock_init(&async->lock);
+	INIT_LIST_HEAD(&async->queue);
+	INIT_WORK(&async->work, sp_i2c_async_work);
+	async->adap = &pstSpI2CInfo->adap;
+	snprintf(async->name, sizeof(async->name), "%s-async", pstSpI2CInfo->adap.name);
+	async->misc.minor = MISC_DYNAMIC_MINOR;
+	async->misc.name = async->name;
+	async->misc.fops = &sp_i2c_async_fops;
+	async->misc.parent = pstSpI2CInfo->dev;
+
+	ret = misc_register(&async->misc);
+	if (ret) {
+		kfree(async);
+		return ret;
+	}
+
+	pstSpI2CInfo->async = async;
 	return 0;
-#endif
 }
 
-static int sp_unreg_slave(struct i2c_client *slave)
+/* Stop taking requests and fail what is still queued */
+static void sp_i2c_async_exit(struct SpI2C_If_t_ *pstSpI2CInfo)
 {
-	struct SpI2C_If_t_ *priv = i2c_get_adapdata(slave->adapter);
-	struct regs_i2cs_s *sr = (struct regs_i2cs_s *)priv->i2c_slave_regs;
+	struct sp_i2c_async *async = pstSpI2CInfo->async;
+	struct sp_i2c_async_xfer *xfer, *tmp;
+	LIST_HEAD(queue);
 
-	WARN_ON(!priv->slave);
+	if (!async)
+		return;
 
-	/* ensure no irq is running before clearing ptr */
-	disable_irq(priv->irq_slave);
-	writel(0, &sr->interrupt);
-	writel(0, &sr->status);
-	enable_irq(priv->irq_slave);
-	//rcar_i2c_write(priv, ICSCR, SDBS);
-	sp_i2cs_addr_set(sr, 0);
-	//sp_i2cs_disable_slave(sr);
-	priv->slave = NULL;
+	misc_deregister(&async->misc);
 
-#ifdef CONFIG_PM_RUNTIME_I2C
-	pm_runtime_put(rcar_i2c_priv_to_dev(priv));
-#endif
-	return 0;
+	spin_lock_irq(&async->lock);
+	async->dead = true;
+	spin_unlock_irq(&async->lock);
+	cancel_work_sync(&async->work);
+
+	spin_lock_irq(&async->lock);
+	list_splice_init(&async->queue, &queue);
+	spin_unlock_irq(&async->lock);
+
+	list_for_each_entry_safe(xfer, tmp, &queue, node) {
+		list_del(&xfer->node);
+		xfer->complete(xfer, -ESHUTDOWN);
+	}
+
+	kref_put(&async->ref, sp_i2c_async_release);
+	pstSpI2CInfo->async = NULL;
 }
-#endif
 
-static struct i2c_algorithm sp_algorithm = {
-	.master_xfer	= sp_master_xfer,
-	.functionality	= sp_functionality,
-#if IS_ENABLED(CONFIG_I2C_SLAVE)
-	.reg_slave = sp_reg_slave,
-	.unreg_slave = sp_unreg_slave,
-#endif
-};
+/*
+ * Bus recovery needs a "gpio" pinctrl state that hands SCL (and SDA, to see
+ * when the target lets go) to the GPIO block, and the matching scl-gpios
+ * and sda-gpios. Without them the adapter works as before, minus recovery.
+ */
+static void _sp_i2cm_recovery_init(struct SpI2C_If_t_ *pstSpI2CInfo)
+{
+	struct i2c_bus_recovery_info *bri = &pstSpI2CInfo->stRecovery;
+	struct device *dev = pstSpI2CInfo->dev;
+
+	bri->pinctrl = devm_pinctrl_get(dev);
+	if (IS_ERR_OR_NULL(bri->pinctrl))
+		goto none;
+
+	bri->pins_default = pinctrl_lookup_state(bri->pinctrl, PINCTRL_STATE_DEFAULT);
+	bri->pins_gpio = pinctrl_lookup_state(bri->pinctrl, "gpio");
+	if (IS_ERR(bri->pins_default) || IS_ERR(bri->pins_gpio))
+		goto none;
+
+	// the pads are claimed as GPIOs in their GPIO function, then handed back
+	pinctrl_select_state(bri->pinctrl, bri->pins_gpio);
+	bri->scl_gpiod = devm_gpiod_get_optional(dev, "scl", GPIOD_OUT_HIGH_OPEN_DRAIN);
+	bri->sda_gpiod = devm_gpiod_get_optional(dev, "sda", GPIOD_IN);
+	pinctrl_select_state(bri->pinctrl, bri->pins_default);
+
+	if (IS_ERR_OR_NULL(bri->scl_gpiod) || IS_ERR(bri->sda_gpiod)) {
+		dev_warn(dev, "no usable scl/sda gpios, bus recovery disabled\n");
+		goto none;
+	}
+
+	bri->recover_bus = i2c_generic_scl_recovery;
+	pstSpI2CInfo->adap.bus_recovery_info = bri;
+	return;
+
+none:
+	memset(bri, 0, sizeof(*bri));
+}
 
 static int sp_i2c_probe(struct platform_device *pdev)
 {
 	struct SpI2C_If_t_ *pstSpI2CInfo;
 	struct i2c_adapter *p_adap;
-	unsigned int i2c_clk_freq;
 	int device_id = 0;
 	int ret = I2C_SUCCESS;
 	struct device *dev = &pdev->dev;
-	const struct i2c_compatible *dev_mode;
-#if IS_ENABLED(CONFIG_I2C_SLAVE)
-#if 0
-	struct device_node *memnp;
-	struct resource mem_res;
-	int rc;
-	unsigned long iop_reserve_base;
-	unsigned long iop_reserve_size;
-	void __iomem *iop_base;
-	void __iomem *data_buffer_base;
-#endif
-#endif
 
 	FUNC_DEBUG();
 
@@ -2131,21 +3950,15 @@ static int sp_i2c_probe(struct platform_device *pdev)
 		pdev->id = of_alias_get_id(pdev->dev.of_node, "i2c");
 		DBG_INFO("[I2C adapter] pdev->id=%d\n", pdev->id);
 		device_id = pdev->id;
+	} else if (pdev->id > 0) {
+		device_id = pdev->id;
 	}
 
 	pstSpI2CInfo = devm_kzalloc(&pdev->dev, sizeof(*pstSpI2CInfo), GFP_KERNEL);
 	if (!pstSpI2CInfo)
 		return -ENOMEM;
 
-	if (!of_property_read_u32(pdev->dev.of_node, "clock-frequency", &i2c_clk_freq)) {
-		dev_dbg(&pdev->dev, "clk_freq %d\n", i2c_clk_freq);
-		pstSpI2CInfo->i2c_clk_freq = i2c_clk_freq;
-	} else
-		pstSpI2CInfo->i2c_clk_freq = I2C_FREQ*1000;
-
-		DBG_INFO("[I2C adapter] get freq : %d\n", pstSpI2CInfo->i2c_clk_freq);
-
-		pstSpI2CInfo->dev = &pdev->dev;
+	pstSpI2CInfo->dev = &pdev->dev;
 
 	ret = _sp_i2cm_get_resources(pdev, pstSpI2CInfo);
 	if (ret != I2C_SUCCESS) {
@@ -2160,79 +3973,64 @@ static int sp_i2c_probe(struct platform_device *pdev)
 		return ret;
 	}
 	DBG_INFO("[I2C slave] 0x%x\n", (u32)pstSpI2CInfo->i2c_slave_regs);
-#if 0
-	//Get reserve address
-	memnp = of_parse_phandle(pdev->dev.of_node, "memory-region", 0);
-	if (!memnp) {
-		DBG_ERR("no memory-region node\n");
-		return -EINVAL;
-	}
-
-	rc = of_address_to_resource(memnp, 0, &mem_res);
-	of_node_put(memnp);
-	if (rc) {
-		DBG_ERR("failed to translate memory-region to a resource\n");
-		return -EINVAL;
-	}
-
-	iop_reserve_base = mem_res.start;
-	iop_reserve_size = resource_size(&mem_res);
-	datarx_phys = iop_reserve_base + RX_OFFSET;
-	datatx_phys = iop_reserve_base + TX_OFFSET;
-	
-	DBG_INFO("mem_res.start=%lx\n", iop_reserve_base);
-	DBG_INFO("mem_res.size=%lx\n", iop_reserve_size);
-
-	data_buffer_base = ioremap((unsigned long)iop_reserve_base, iop_reserve_size);
-	datarx = data_buffer_base + RX_OFFSET;
-	datatx = data_buffer_base + TX_OFFSET;
-#endif
 #endif
 
-	pstSpI2CInfo->clk = devm_clk_get(dev, NULL);
+	/* the software model has neither a clock nor a reset line */
+	if (dev_get_platdata(dev))
+		pstSpI2CInfo->clk = devm_clk_get_optional(dev, NULL);
+	else
+		pstSpI2CInfo->clk = devm_clk_get(dev, NULL);
 
 	if (IS_ERR(pstSpI2CInfo->clk)) {
 		ret = PTR_ERR(pstSpI2CInfo->clk);
 		dev_err(dev, "failed to retrieve clk: %d\n", ret);
-		goto err_clk_disable;
+		return ret;
 	}
 	ret = clk_prepare_enable(pstSpI2CInfo->clk);
 
 	if (ret) {
 		dev_err(dev, "failed to enable clk: %d\n", ret);
-		goto err_clk_disable;
+		return ret;
 	}
 
-	pstSpI2CInfo->rstc = devm_reset_control_get(dev, NULL);
+	if (dev_get_platdata(dev))
+		pstSpI2CInfo->rstc = devm_reset_control_get_optional_exclusive(dev, NULL);
+	else
+		pstSpI2CInfo->rstc = devm_reset_control_get(dev, NULL);
 
 	if (IS_ERR(pstSpI2CInfo->rstc)) {
 		ret = PTR_ERR(pstSpI2CInfo->rstc);
 		dev_err(dev, "failed to retrieve reset controller: %d\n", ret);
-		goto err_reset_assert;
+		goto err_clk_disable;
 	}
 	ret = reset_control_deassert(pstSpI2CInfo->rstc);
 
 	if (ret) {
 		dev_err(dev, "failed to deassert reset line: %d\n", ret);
-		goto err_reset_assert;
+		goto err_clk_disable;
 	}
 
+	_sp_i2cm_timing_init(pstSpI2CInfo);
+	_sp_i2cm_target_speed_init(pstSpI2CInfo);
+
 	/* dma alloc*/
 	pstSpI2CInfo->dma_vir_base = dma_alloc_coherent(&pdev->dev, I2C_BUFFER_SIZE,
 					&pstSpI2CInfo->dma_phy_base, GFP_ATOMIC);
-	if (!pstSpI2CInfo->dma_vir_base)
-		goto free_dma;
+	if (!pstSpI2CInfo->dma_vir_base) {
+		ret = -ENOMEM;
+		goto err_reset_assert;
+	}
 
 	ret = _sp_i2cm_init(device_id, pstSpI2CInfo);
 	if (ret != 0) {
 		DBG_ERR("[I2C adapter] i2c master %d init error\n", device_id);
-		return ret;
+		ret = -ENODEV;
+		goto free_dma;
 	}
 
 	init_waitqueue_head(&pstSpI2CInfo->wait);
+	pstSpI2CInfo->dBurstBytes = I2C_BURST_RDATA_BYTES;
 
-	dev_mode = of_device_get_match_data(&pdev->dev);
-	pstSpI2CInfo->mode = dev_mode->mode;
 	p_adap = &pstSpI2CInfo->adap;
 	sprintf(p_adap->name, "%s%d", DEVICE_NAME, device_id);
 	p_adap->algo = &sp_algorithm;
@@ -2244,43 +4042,81 @@ static int sp_i2c_probe(struct platform_device *pdev)
 	p_adap->dev.of_node = pdev->dev.of_node;
 	
 	i2c_set_adapdata(p_adap, pstSpI2CInfo);
-	
+	_sp_i2cm_recovery_init(pstSpI2CInfo);
+	platform_set_drvdata(pdev, pstSpI2CInfo);
+
+	// clients may talk to the bus while the adapter is added
+	ret = devm_request_irq(dev, pstSpI2CInfo->irq, _sp_i2cm_irqevent_handler,
+			       IRQF_TRIGGER_HIGH, p_adap->name, pstSpI2CInfo);
+	if (ret) {
+		DBG_ERR("request irq fail !!\n");
+		goto free_dma;
+	}
+
+	pm_runtime_set_autosuspend_delay(dev, I2C_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_set_active(dev);
+	pm_runtime_enable(dev);
+
 	ret = i2c_add_numbered_adapter(p_adap);
 	if (ret < 0) {
 		DBG_ERR("[I2C adapter] error add adapter %s\n", p_adap->name);
-		goto free_dma;
+		goto err_pm_disable;
 	} else {
 		DBG_INFO("[I2C adapter] add adapter %s success\n", p_adap->name);
-		platform_set_drvdata(pdev, pstSpI2CInfo);
 	}
 
-	ret = request_irq(pstSpI2CInfo->irq, _sp_i2cm_irqevent_handler, IRQF_TRIGGER_HIGH,
-				p_adap->name, pstSpI2CInfo);
-	if (ret) {
-		DBG_ERR("request irq fail !!\n");
-		return I2C_ERR_REQUESET_IRQ;
+#if IS_ENABLED(CONFIG_I2C_SLAVE)
+	if (pstSpI2CInfo->i2c_slave_regs) {
+		ret = devm_request_threaded_irq(dev, pstSpI2CInfo->irq_slave,
+			_sp_i2cs_irqevent_handler, _sp_i2cs_irqevent_handler_thread,
+			IRQF_TRIGGER_HIGH | IRQF_NO_SUSPEND | IRQF_ONESHOT,
+			p_adap->name, pstSpI2CInfo);
+		if (ret) {
+			DBG_ERR("request slave irq fail !!\n");
+			goto err_del_adapter;
+		}
 	}
+#endif
 
+	if (sp_i2c_async_init(pstSpI2CInfo))
+		dev_warn(dev, "no async character device\n");
+
+	pstSpI2CInfo->debugfs = debugfs_create_dir(dev_name(&p_adap->dev), sp_i2c_debugfs);
+	debugfs_create_file("targets", 0600, pstSpI2CInfo->debugfs, pstSpI2CInfo,
+			    &sp_i2c_targets_fops);
 #if IS_ENABLED(CONFIG_I2C_SLAVE)
-	ret = devm_request_threaded_irq(dev, pstSpI2CInfo->irq_slave,
-		_sp_i2cs_irqevent_handler, _sp_i2cs_irqevent_handler_thread,
-		IRQF_TRIGGER_HIGH | IRQF_NO_SUSPEND | IRQF_ONESHOT,
-		p_adap->name, pstSpI2CInfo);
-	if (ret) {
-		DBG_ERR("request slave irq fail !!\n");
-		return I2C_ERR_REQUESET_IRQ;	
+	if (pstSpI2CInfo->i2c_slave_regs) {
+		pstSpI2CInfo->selftest = devm_kzalloc(dev, sizeof(*pstSpI2CInfo->selftest), GFP_KERNEL);
+		if (pstSpI2CInfo->selftest) {
+			mutex_init(&pstSpI2CInfo->selftest->lock);
+			debugfs_create_file("selftest", 0600, pstSpI2CInfo->debugfs,
+					    pstSpI2CInfo, &sp_i2cs_selftest_fops);
+		}
 	}
 #endif
-
-#ifdef CONFIG_PM_RUNTIME_I2C
-	pm_runtime_set_autosuspend_delay(&pdev->dev, 5000);
-	pm_runtime_use_autosuspend(&pdev->dev);
-	pm_runtime_set_active(&pdev->dev);
-	pm_runtime_enable(&pdev->dev);
+#ifdef CONFIG_I2C_SUNPLUS_MODEL
+	if (dev_get_platdata(dev)) {
+		pstSpI2CInfo->sweep = devm_kzalloc(dev, sizeof(*pstSpI2CInfo->sweep), GFP_KERNEL);
+		if (pstSpI2CInfo->sweep) {
+			mutex_init(&pstSpI2CInfo->sweep->lock);
+			debugfs_create_file("burst_sweep", 0600, pstSpI2CInfo->debugfs,
+					    pstSpI2CInfo, &sp_i2cm_sweep_fops);
+		}
+	}
 #endif
 
 	return ret;
 
+#if IS_ENABLED(CONFIG_I2C_SLAVE)
+err_del_adapter:
+	i2c_del_adapter(p_adap);
+#endif
+err_pm_disable:
+	pm_runtime_disable(dev);
+	pm_runtime_set_suspended(dev);
+	pm_runtime_dont_use_autosuspend(dev);
+
 free_dma:
 	dma_free_coherent(&pdev->dev, I2C_BUFFER_SIZE, pstSpI2CInfo->dma_vir_base, pstSpI2CInfo->dma_phy_base);
 
@@ -2300,129 +4136,139 @@ static int sp_i2c_remove(struct platform_device *pdev)
 
 	FUNC_DEBUG();
 
-#ifdef CONFIG_PM_RUNTIME_I2C
-	pm_runtime_disable(&pdev->dev);
-	pm_runtime_set_suspended(&pdev->dev);
-#endif
+	// the clock must be running when it is finally disabled
+	pm_runtime_get_sync(&pdev->dev);
 
-	dma_free_coherent(&pdev->dev, I2C_BUFFER_SIZE, pstSpI2CInfo->dma_vir_base, pstSpI2CInfo->dma_phy_base);
+	debugfs_remove_recursive(pstSpI2CInfo->debugfs);
+	sp_i2c_async_exit(pstSpI2CInfo);
 
+	// no transfer can be running once the adapter is gone
 	i2c_del_adapter(p_adap);
+	dma_free_coherent(&pdev->dev, I2C_BUFFER_SIZE, pstSpI2CInfo->dma_vir_base, pstSpI2CInfo->dma_phy_base);
+
+	pm_runtime_disable(&pdev->dev);
+	pm_runtime_dont_use_autosuspend(&pdev->dev);
+	pm_runtime_put_noidle(&pdev->dev);
+	pm_runtime_set_suspended(&pdev->dev);
 	if (p_adap->nr < I2C_MASTER_NUM) {
 		clk_disable_unprepare(pstSpI2CInfo->clk);
 		reset_control_assert(pstSpI2CInfo->rstc);
-		free_irq(pstSpI2CInfo->irq, NULL);
 	}
 
 	return 0;
 }
 
-static int sp_i2c_suspend(struct platform_device *pdev, pm_message_t state)
-{
-	struct SpI2C_If_t_ *pstSpI2CInfo = platform_get_drvdata(pdev);
-	struct i2c_adapter *p_adap = &pstSpI2CInfo->adap;
+static const struct of_device_id sp_i2c_of_match[] = {
+	{	.compatible = "sunplus,sp7021-i2cm", },
+	{	.compatible = "sunplus,q645-i2cm", },
+	{ /* sentinel */ }
+};
+MODULE_DEVICE_TABLE(of, sp_i2c_of_match);
 
-	FUNC_DEBUG();
+static int __maybe_unused sp_i2c_runtime_suspend(struct device *dev)
+{
+	struct SpI2C_If_t_ *pstSpI2CInfo = dev_get_drvdata(dev);
 
-	if (p_adap->nr < I2C_MASTER_NUM)
-		reset_control_assert(pstSpI2CInfo->rstc);
+	// stays prepared, so that atomic transfers can enable it
+	clk_disable(pstSpI2CInfo->clk);
+	pstSpI2CInfo->tSuspend = ktime_get();
+	atomic64_inc(&pstSpI2CInfo->stStats.pm_suspends);
 
 	return 0;
 }
 
-static int sp_i2c_resume(struct platform_device *pdev)
+static int __maybe_unused sp_i2c_runtime_resume(struct device *dev)
 {
-	struct SpI2C_If_t_ *pstSpI2CInfo = platform_get_drvdata(pdev);
-	struct i2c_adapter *p_adap = &pstSpI2CInfo->adap;
+	struct SpI2C_If_t_ *pstSpI2CInfo = dev_get_drvdata(dev);
+	int ret;
 
-	FUNC_DEBUG();
+	ret = clk_enable(pstSpI2CInfo->clk);
+	if (ret)
+		return ret;
 
-	if (p_adap->nr < I2C_MASTER_NUM) {
-		reset_control_deassert(pstSpI2CInfo->rstc);   //release reset
-		clk_prepare_enable(pstSpI2CInfo->clk);        //enable clken and disable gclken
-	}
+	atomic64_add(ktime_us_delta(ktime_get(), pstSpI2CInfo->tSuspend),
+		     &pstSpI2CInfo->stStats.pm_gated_us);
+	atomic64_inc(&pstSpI2CInfo->stStats.pm_resumes);
 
 	return 0;
 }
 
-static const struct i2c_compatible i2c_7021_compat = {
-	.mode = I2C_POWER_ALL_SWITCH,
-};
-
-static const struct i2c_compatible i2c_645_compat = {
-	.mode = I2C_POWER_NO_SWITCH,
-};
-
-
-static const struct of_device_id sp_i2c_of_match[] = {
-	{	.compatible = "sunplus,sp7021-i2cm",
-		.data = &i2c_7021_compat, },
-	{	.compatible = "sunplus,q645-i2cm",
-		.data = &i2c_645_compat, },
-	{ /* sentinel */ }
-};
-MODULE_DEVICE_TABLE(of, sp_i2c_of_match);
-
-#ifdef CONFIG_PM_RUNTIME_I2C
-static int sp_i2c_runtime_suspend(struct device *dev)
+/* System sleep also holds the block in reset, which loses the slave setup */
+static int __maybe_unused sp_i2c_suspend(struct device *dev)
 {
 	struct SpI2C_If_t_ *pstSpI2CInfo = dev_get_drvdata(dev);
-	struct i2c_adapter *p_adap = &pstSpI2CInfo->adap;
+	int ret;
 
 	FUNC_DEBUG();
 
-	if (p_adap->nr < I2C_MASTER_NUM)
+	ret = pm_runtime_force_suspend(dev);
+	if (ret)
+		return ret;
+
+	if (pstSpI2CInfo->adap.nr < I2C_MASTER_NUM)
 		reset_control_assert(pstSpI2CInfo->rstc);
 
 	return 0;
 }
 
-static int sp_i2c_runtime_resume(struct device *dev)
+static int __maybe_unused sp_i2c_resume(struct device *dev)
 {
 	struct SpI2C_If_t_ *pstSpI2CInfo = dev_get_drvdata(dev);
-	struct i2c_adapter *p_adap = &pstSpI2CInfo->adap;
+	int ret;
 
 	FUNC_DEBUG();
 
-	if (p_adap->nr < I2C_MASTER_NUM) {
+	if (pstSpI2CInfo->adap.nr < I2C_MASTER_NUM)
 		reset_control_deassert(pstSpI2CInfo->rstc);   //release reset
-		clk_prepare_enable(pstSpI2CInfo->clk);        //enable clken and disable gclken
-	}
+
+	ret = pm_runtime_force_resume(dev);
+	if (ret)
+		return ret;
+
+#if IS_ENABLED(CONFIG_I2C_SLAVE)
+	// a registered slave holds a reference, the clock is on again here
+	if (pstSpI2CInfo->slave)
+		_sp_i2cs_slave_start(pstSpI2CInfo);
+#endif
 
 	return 0;
 }
+
 static const struct dev_pm_ops sp7021_i2c_pm_ops = {
-	.runtime_suspend = sp_i2c_runtime_suspend,
-	.runtime_resume  = sp_i2c_runtime_resume,
+	SET_SYSTEM_SLEEP_PM_OPS(sp_i2c_suspend, sp_i2c_resume)
+	SET_RUNTIME_PM_OPS(sp_i2c_runtime_suspend, sp_i2c_runtime_resume, NULL)
 };
 
-#define sp_i2c_pm_ops  (&sp7021_i2c_pm_ops)
-#endif
-
 static struct platform_driver sp_i2c_driver = {
 	.probe		= sp_i2c_probe,
 	.remove		= sp_i2c_remove,
-	.suspend	= sp_i2c_suspend,
-	.resume		= sp_i2c_resume,
 	.driver		= {
 		.owner		= THIS_MODULE,
 		.name		= DEVICE_NAME,
 		.of_match_table = sp_i2c_of_match,
-#ifdef CONFIG_PM_RUNTIME_I2C
-		.pm     = sp_i2c_pm_ops,
-#endif
+		.pm		= &sp7021_i2c_pm_ops,
+		.dev_groups	= sp_i2c_groups,
 	},
 };
 
 static int __init sp_i2c_adap_init(void)
 {
-	return platform_driver_register(&sp_i2c_driver);
+	int ret;
+
+	sp_i2c_debugfs = debugfs_create_dir(DEVICE_NAME, NULL);
+
+	ret = platform_driver_register(&sp_i2c_driver);
+	if (ret)
+		debugfs_remove_recursive(sp_i2c_debugfs);
+
+	return ret;
 }
 module_init(sp_i2c_adap_init);
 
 static void __exit sp_i2c_adap_exit(void)
 {
 	platform_driver_unregister(&sp_i2c_driver);
+	debugfs_remove_recursive(sp_i2c_debugfs);
 }
 module_exit(sp_i2c_adap_exit);
 
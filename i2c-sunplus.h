@@ -0,0 +1,262 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Copyright (c) 2021 Sunplus Inc.
+ * Author: LH Kuo <lh.kuo@sunplus.com>
+ *
+ * SP7021 I2C master (I2CM) register layout, shared by the driver and the
+ * software model of the block.
+ */
+
+#ifndef __I2C_SUNPLUS_H__
+#define __I2C_SUNPLUS_H__
+
+#include <linux/i2c.h>
+#include <linux/types.h>
+
+#include "sp7021-i2c-async.h"
+
+//control0
+#define I2C_CTL0_FREQ(x)                  (x<<24)  //bit[26:24]
+#define I2C_CTL0_PREFETCH                 (1<<18)  //Now as read mode need to set high, otherwise dont care
+#define I2C_CTL0_RESTART_EN               (1<<17)  //0:disable 1:enable
+#define I2C_CTL0_SUBADDR_EN               (1<<16)  //For restart mode need to set high
+#define I2C_CTL0_SW_RESET                 (1<<15)
+#define I2C_CTL0_SLAVE_ADDR(x)            (x<<1)   //bit[7:1]
+
+//control1
+#define I2C_CTL1_ALL_CLR                  (0x3FF)
+#define I2C_CTL1_EMPTY_CLR                (1<<9)
+#define I2C_CTL1_SCL_HOLD_TOO_LONG_CLR    (1<<8)
+#define I2C_CTL1_SCL_WAIT_CLR             (1<<7)
+#define I2C_CTL1_EMPTY_THRESHOLD_CLR      (1<<6)
+#define I2C_CTL1_DATA_NACK_CLR            (1<<5)
+#define I2C_CTL1_ADDRESS_NACK_CLR         (1<<4)
+#define I2C_CTL1_BUSY_CLR                 (1<<3)
+#define I2C_CTL1_CLKERR_CLR               (1<<2)
+#define I2C_CTL1_DONE_CLR                 (1<<1)
+#define I2C_CTL1_SIFBUSY_CLR              (1<<0)
+
+//control2
+#define I2C_CTL2_FREQ_CUSTOM(x)           (x<<0)   //bit[10:0]
+#define I2C_CTL2_SCL_DELAY(x)             (x<<24)  //bit[25:24]
+#define I2C_CTL2_SDA_HALF_ENABLE          (1<<31)
+
+//control7
+#define I2C_CTL7_RDCOUNT(x)               (x<<16)  //bit[31:16]
+#define I2C_CTL7_WRCOUNT(x)               (x<<0)   //bit[15:0]
+
+
+#define I2C_CTL0_FREQ_MASK                  (0x7)     // 3 bit
+#define I2C_CTL0_SLAVE_ADDR_MASK            (0x7F)    // 7 bit
+#define I2C_CTL2_FREQ_CUSTOM_MASK           (0x7FF)   // 11 bit
+#define I2C_CTL2_SCL_DELAY_MASK             (0x3)     // 2 bit
+#define I2C_CTL7_RW_COUNT_MASK              (0xFFFF)  // 16 bit
+#define I2C_EN0_CTL_EMPTY_THRESHOLD_MASK    (0x7)     // 3 bit
+#define I2C_SG_DMA_LLI_INDEX_MASK           (0x1F)    // 5 bit
+
+//interrupt enable1
+#define I2C_EN1_BURST_RDATA_INT           (0x80008000)  //must sync with GET_BYTES_EACHTIME
+
+//interrupt enable2
+#define I2C_EN2_BURST_RDATA_OVERFLOW_INT  (0xFFFFFFFF)
+
+//i2c master mode
+#define I2C_MODE_DMA_MODE                 (1<<2)
+#define I2C_MODE_MANUAL_MODE              (1<<1)  //0:trigger mode 1:auto mode
+#define I2C_MODE_MANUAL_TRIG              (1<<0)
+
+
+//dma config
+#define I2C_DMA_CFG_DMA_GO                (1<<8)
+#define I2C_DMA_CFG_NON_BUF_MODE          (1<<2)
+#define I2C_DMA_CFG_SAME_SLAVE            (1<<1)
+#define I2C_DMA_CFG_DMA_MODE              (1<<0)
+
+//dma interrupt flag
+#define I2C_DMA_INT_LENGTH0_FLAG          (1<<6)
+#define I2C_DMA_INT_THRESHOLD_FLAG        (1<<5)
+#define I2C_DMA_INT_IP_TIMEOUT_FLAG       (1<<4)
+#define I2C_DMA_INT_GDMA_TIMEOUT_FLAG     (1<<3)
+#define I2C_DMA_INT_WB_EN_ERROR_FLAG      (1<<2)
+#define I2C_DMA_INT_WCNT_ERROR_FLAG       (1<<1)
+#define I2C_DMA_INT_DMA_DONE_FLAG         (1<<0)
+
+//dma interrupt enable
+#define I2C_DMA_EN_LENGTH0_INT            (1<<6)
+#define I2C_DMA_EN_THRESHOLD_INT          (1<<5)
+#define I2C_DMA_EN_IP_TIMEOUT_INT         (1<<4)
+#define I2C_DMA_EN_GDMA_TIMEOUT_INT       (1<<3)
+#define I2C_DMA_EN_WB_EN_ERROR_INT        (1<<2)
+#define I2C_DMA_EN_WCNT_ERROR_INT         (1<<1)
+#define I2C_DMA_EN_DMA_DONE_INT           (1<<0)
+
+//interrupt
+#define I2C_INT_RINC_INDEX(x)             (x<<18)  //bit[20:18]
+#define I2C_INT_WINC_INDEX(x)             (x<<15)  //bit[17:15]
+#define I2C_INT_SCL_HOLD_TOO_LONG_FLAG    (1<<11)
+#define I2C_INT_WFIFO_ENABLE              (1<<10)
+#define I2C_INT_FULL_FLAG                 (1<<9)
+#define I2C_INT_EMPTY_FLAG                (1<<8)
+#define I2C_INT_SCL_WAIT_FLAG             (1<<7)
+#define I2C_INT_EMPTY_THRESHOLD_FLAG      (1<<6)
+#define I2C_INT_DATA_NACK_FLAG            (1<<5)
+#define I2C_INT_ADDRESS_NACK_FLAG         (1<<4)
+#define I2C_INT_BUSY_FLAG                 (1<<3)
+#define I2C_INT_CLKERR_FLAG               (1<<2)
+#define I2C_INT_DONE_FLAG                 (1<<1)
+#define I2C_INT_SIFBUSY_FLAG              (1<<0)
+
+
+//interrupt enable0
+#define I2C_EN0_SCL_HOLD_TOO_LONG_INT     (1<<13)
+#define I2C_EN0_NACK_INT                  (1<<12)
+#define I2C_EN0_CTL_EMPTY_THRESHOLD(x)    (x<<9)  //bit[11:9]
+#define I2C_EN0_EMPTY_INT                 (1<<8)
+#define I2C_EN0_SCL_WAIT_INT              (1<<7)
+#define I2C_EN0_EMPTY_THRESHOLD_INT       (1<<6)
+#define I2C_EN0_DATA_NACK_INT             (1<<5)
+#define I2C_EN0_ADDRESS_NACK_INT          (1<<4)
+#define I2C_EN0_BUSY_INT                  (1<<3)
+#define I2C_EN0_CLKERR_INT                (1<<2)
+#define I2C_EN0_DONE_INT                  (1<<1)
+#define I2C_EN0_SIFBUSY_INT               (1<<0)
+
+struct regs_i2cm_s {
+	unsigned int control0;      /* 00 */
+	unsigned int control1;      /* 01 */
+	unsigned int control2;      /* 02 */
+	unsigned int control3;      /* 03 */
+	unsigned int control4;      /* 04 */
+	unsigned int control5;      /* 05 */
+	unsigned int i2cm_status0;  /* 06 */
+	unsigned int interrupt;     /* 07 */
+	unsigned int int_en0;       /* 08 */
+	unsigned int i2cm_mode;     /* 09 */
+	unsigned int i2cm_status1;  /* 10 */
+	unsigned int i2cm_status2;  /* 11 */
+	unsigned int control6;      /* 12 */
+	unsigned int int_en1;       /* 13 */
+	unsigned int i2cm_status3;  /* 14 */
+	unsigned int i2cm_status4;  /* 15 */
+	unsigned int int_en2;       /* 16 */
+	unsigned int control7;      /* 17 */
+	unsigned int control8;      /* 18 */
+	unsigned int control9;      /* 19 */
+	unsigned int reserved[3];   /* 20~22 */
+	unsigned int version;       /* 23 */
+	unsigned int data00_03;     /* 24 */
+	unsigned int data04_07;     /* 25 */
+	unsigned int data08_11;     /* 26 */
+	unsigned int data12_15;     /* 27 */
+	unsigned int data16_19;     /* 28 */
+	unsigned int data20_23;     /* 29 */
+	unsigned int data24_27;     /* 30 */
+	unsigned int data28_31;     /* 31 */
+};
+
+struct regs_i2cm_dma_s {
+	unsigned int hw_version;                /* 00 */
+	unsigned int dma_config;                /* 01 */
+	unsigned int dma_length;                /* 02 */
+	unsigned int dma_addr;                  /* 03 */
+	unsigned int port_mux;                  /* 04 */
+	unsigned int int_flag;                  /* 05 */
+	unsigned int int_en;                    /* 06 */
+	unsigned int sw_reset_state;            /* 07 */
+	unsigned int reserved[2];               /* 08~09 */
+	unsigned int sg_dma_index;              /* 10 */
+	unsigned int sg_dma_config;             /* 11 */
+	unsigned int sg_dma_length;             /* 12 */
+	unsigned int sg_dma_addr;               /* 13 */
+	unsigned int reserved2;                 /* 14 */
+	unsigned int sg_setting;                /* 15 */
+	unsigned int threshold;                 /* 16 */
+	unsigned int reserved3;                 /* 17 */
+	unsigned int gdma_read_timeout;         /* 18 */
+	unsigned int gdma_write_timeout;        /* 19 */
+	unsigned int ip_read_timeout;           /* 20 */
+	unsigned int ip_write_timeout;          /* 21 */
+	unsigned int write_cnt_debug;           /* 22 */
+	unsigned int w_byte_en_debug;           /* 23 */
+	unsigned int sw_reset_write_cnt_debug;  /* 24 */
+	unsigned int reserved4[7];              /* 25~31 */
+};
+
+#ifdef CONFIG_I2C_SUNPLUS_MODEL
+/*
+ * The model keeps its register file in plain memory and has to see every
+ * access, so the driver goes through these instead of readl()/writel().
+ * Addresses outside a model instance are passed on to the real accessors.
+ */
+u32 sp_i2cm_model_readl(const volatile void __iomem *addr);
+void sp_i2cm_model_writel(u32 val, volatile void __iomem *addr);
+
+#define sp_readl(addr)          sp_i2cm_model_readl(addr)
+#define sp_writel(val, addr)    sp_i2cm_model_writel(val, addr)
+
+/* What a model instance counted, as its debugfs file reports it */
+struct sp_i2cm_model_counters {
+	u64 reads;
+	u64 writes;
+	u64 irqs;
+	u64 xfers;
+	u64 bytes;
+};
+
+int sp_i2cm_model_counters(const volatile void __iomem *regs,
+			   struct sp_i2cm_model_counters *cnt, bool reset);
+#else
+#define sp_readl(addr)          readl(addr)
+#define sp_writel(val, addr)    writel(val, addr)
+#endif
+
+/* Handed to the driver by the model in place of MMIO resources */
+struct sp_i2cm_model_pdata {
+	void __iomem *i2c_regs;
+	void __iomem *i2c_dma_regs;
+};
+
+/*
+ * Asynchronous transfers. The descriptor is queued on the adapter and run
+ * in order, back to back with the others, by a worker that holds the bus
+ * for a batch. complete() is called from that worker with the result of
+ * __i2c_transfer() once the bus is released again, so it may submit again
+ * or run synchronous transfers on the same adapter.
+ */
+struct sp_i2c_async_xfer {
+	struct list_head node;          /* driver use */
+	struct i2c_msg *msgs;
+	int num;
+	void (*complete)(struct sp_i2c_async_xfer *xfer, int ret);
+	void *context;
+};
+
+int sp_i2c_async_submit(struct i2c_adapter *adap, struct sp_i2c_async_xfer *xfer);
+
+/*
+ * Run transfers to the 7-bit address at bus_freq_hz (up to 1 MHz) instead
+ * of the adapter's clock-frequency, the closest precomputed speed not above
+ * it is used, -ERANGE if there is none. 0 returns the target to the adapter
+ * speed. Either way the adaptive timing of the target starts over from that
+ * speed.
+ */
+int sp_i2c_set_target_speed(struct i2c_adapter *adap, u16 addr, u32 bus_freq_hz);
+
+/*
+ * Run a batch spread over several SP7021 adapters, e.g. one sensor bank per
+ * controller. The adapters work in parallel, entries for the same adapter
+ * run in order. Returns when every entry has finished, with each ret set to
+ * the __i2c_transfer() result (num on success), and 0 or the first error.
+ * Sleeps, so the entries may live on the caller's stack.
+ */
+struct sp_i2c_stripe_xfer {
+	struct i2c_adapter *adap;
+	struct i2c_msg *msgs;
+	int num;
+	int ret;
+	struct sp_i2c_async_xfer async;  /* driver use */
+};
+
+int sp_i2c_stripe_run(struct sp_i2c_stripe_xfer *xfers, int n);
+
+#endif /* __I2C_SUNPLUS_H__ */
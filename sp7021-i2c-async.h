@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0-only WITH Linux-syscall-note */
+/*
+ * Copyright (c) 2021 Sunplus Inc.
+ *
+ * User space interface of the SP7021 I2C master's asynchronous character
+ * device, /dev/sp7021-i2cm<N>-async. Each write() is one request, a header
+ * followed by wr_len bytes; a request with both lengths set runs as
+ * write-then-read. Each read() returns one completion, a header followed by
+ * rd_len bytes. poll() reports completions (POLLIN) and queue space
+ * (POLLOUT), and O_NONBLOCK gives -EAGAIN, so the file works with plain
+ * read/write submission from io_uring.
+ *
+ * Both headers are 16 bytes without padding, the same on 32 and 64 bit.
+ * Reserved fields must be zero.
+ */
+
+#ifndef _UAPI_SP7021_I2C_ASYNC_H
+#define _UAPI_SP7021_I2C_ASYNC_H
+
+#include <linux/types.h>
+
+struct sp_i2c_async_req {
+	__u64 tag;              /* returned in the completion */
+	__u16 addr;             /* 7-bit target address */
+	__u16 reserved;
+	__u16 wr_len;
+	__u16 rd_len;
+	__u8 data[];            /* wr_len bytes */
+};
+
+struct sp_i2c_async_resp {
+	__u64 tag;
+	__s32 status;           /* 0 or a negative errno */
+	__u16 rd_len;           /* 0 on error */
+	__u16 reserved;
+	__u8 data[];            /* rd_len bytes */
+};
+
+#endif /* _UAPI_SP7021_I2C_ASYNC_H */